@@ -0,0 +1,302 @@
+#include "array_kernels.h"
+#include "runtime.h"
+
+#include <assert.h>
+#include <string.h>
+
+
+static const i32 ELEMENT_TYPE_COUNT = 4;
+
+static_assert((i32)OpCode::OpArrayScaleF64 - (i32)OpCode::OpArraySumS32 + 1 == 6 * ELEMENT_TYPE_COUNT, "Array kernel opcodes out of order");
+
+// Sum, min and max rows, one entry per element type: s32, s64, f32, f64.
+static simd::ArrayReduceKernel s_reduce_kernels[3 * ELEMENT_TYPE_COUNT];
+static simd::ArrayDotKernel    s_dot_kernels[ELEMENT_TYPE_COUNT];
+static simd::ArrayAxpyKernel   s_axpy_kernels[ELEMENT_TYPE_COUNT];
+static simd::ArrayScaleKernel  s_scale_kernels[ELEMENT_TYPE_COUNT];
+
+
+// =========================================================================================================
+// Scalar kernels, used when the cpu has nothing better
+// =========================================================================================================
+
+// Sums and products of integers are computed as simd::WrappingLane, so they wrap the same on every cpu.
+template<typename T>
+static void scalar_sum(const void* elements, i64 count, Slot* result) {
+	typedef typename simd::WrappingLane<T>::Type W;
+	const T* in = (const T*)elements;
+	W sum = 0;
+	for (i64 i = 0; i < count; i++)
+		sum += (W)in[i];
+	memcpy(result, &sum, sizeof(T));
+}
+
+template<typename T>
+static void scalar_min(const void* elements, i64 count, Slot* result) {
+	const T* in = (const T*)elements;
+	T value = count > 0 ? in[0] : 0;
+	for (i64 i = 1; i < count; i++)
+		value = in[i] < value ? in[i] : value;
+	memcpy(result, &value, sizeof(T));
+}
+
+template<typename T>
+static void scalar_max(const void* elements, i64 count, Slot* result) {
+	const T* in = (const T*)elements;
+	T value = count > 0 ? in[0] : 0;
+	for (i64 i = 1; i < count; i++)
+		value = in[i] > value ? in[i] : value;
+	memcpy(result, &value, sizeof(T));
+}
+
+template<typename T>
+static void scalar_dot(const void* a, const void* b, i64 count, Slot* result) {
+	typedef typename simd::WrappingLane<T>::Type W;
+	const T* lhs = (const T*)a;
+	const T* rhs = (const T*)b;
+	W sum = 0;
+	for (i64 i = 0; i < count; i++)
+		sum += (W)lhs[i] * (W)rhs[i];
+	memcpy(result, &sum, sizeof(T));
+}
+
+template<typename T>
+static void scalar_axpy(const Slot* alpha, const void* x, void* y, i64 count) {
+	typedef typename simd::WrappingLane<T>::Type W;
+	T a;
+	memcpy(&a, alpha, sizeof(T));
+	const T* in = (const T*)x;
+	T* out = (T*)y;
+	for (i64 i = 0; i < count; i++)
+		out[i] = (T)((W)a * (W)in[i] + (W)out[i]);
+}
+
+template<typename T>
+static void scalar_scale(const Slot* factor, void* elements, i64 count) {
+	typedef typename simd::WrappingLane<T>::Type W;
+	T f;
+	memcpy(&f, factor, sizeof(T));
+	T* out = (T*)elements;
+	for (i64 i = 0; i < count; i++)
+		out[i] = (T)((W)out[i] * (W)f);
+}
+
+template<typename T>
+static void install_scalar_kernels(i32 element_index) {
+	s_reduce_kernels[0 * ELEMENT_TYPE_COUNT + element_index] = scalar_sum<T>;
+	s_reduce_kernels[1 * ELEMENT_TYPE_COUNT + element_index] = scalar_min<T>;
+	s_reduce_kernels[2 * ELEMENT_TYPE_COUNT + element_index] = scalar_max<T>;
+	s_dot_kernels[element_index]   = scalar_dot<T>;
+	s_axpy_kernels[element_index]  = scalar_axpy<T>;
+	s_scale_kernels[element_index] = scalar_scale<T>;
+}
+
+
+// =========================================================================================================
+// SSE2 & AVX2 kernels
+// =========================================================================================================
+
+#ifdef IPA_X86
+
+/* Generates the six kernels for one element type on one instruction set.
+ * The main loops work on whole vectors, the remaining elements go through the scalar tail, which wraps in W
+ * like the lanes do.
+ * Sums keep two accumulators so consecutive adds do not wait on each other.
+ */
+#define DEFINE_SIMD_ARRAY_KERNELS(prefix, TARGET, T, W, Vector, LANES, LOAD, STORE, SET1, ADD, MUL, MIN, MAX) \
+	TARGET static void prefix##_sum(const void* elements, i64 count, Slot* result) { \
+		const T* in = (const T*)elements; \
+		Vector acc0 = SET1(0), acc1 = SET1(0); \
+		i64 i = 0; \
+		for (; i + 2 * LANES <= count; i += 2 * LANES) { \
+			acc0 = ADD(acc0, LOAD(in + i)); \
+			acc1 = ADD(acc1, LOAD(in + i + LANES)); \
+		} \
+		T lanes[LANES]; \
+		STORE(lanes, ADD(acc0, acc1)); \
+		W sum = 0; \
+		for (i32 l = 0; l < LANES; l++) sum += (W)lanes[l]; \
+		for (; i < count; i++) sum += (W)in[i]; \
+		memcpy(result, &sum, sizeof(T)); \
+	} \
+	DEFINE_SIMD_ARRAY_EXTREMUM(prefix##_min, TARGET, T, Vector, LANES, LOAD, STORE, MIN, <) \
+	DEFINE_SIMD_ARRAY_EXTREMUM(prefix##_max, TARGET, T, Vector, LANES, LOAD, STORE, MAX, >) \
+	TARGET static void prefix##_dot(const void* a, const void* b, i64 count, Slot* result) { \
+		const T* lhs = (const T*)a; \
+		const T* rhs = (const T*)b; \
+		Vector acc0 = SET1(0), acc1 = SET1(0); \
+		i64 i = 0; \
+		for (; i + 2 * LANES <= count; i += 2 * LANES) { \
+			acc0 = ADD(acc0, MUL(LOAD(lhs + i), LOAD(rhs + i))); \
+			acc1 = ADD(acc1, MUL(LOAD(lhs + i + LANES), LOAD(rhs + i + LANES))); \
+		} \
+		T lanes[LANES]; \
+		STORE(lanes, ADD(acc0, acc1)); \
+		W sum = 0; \
+		for (i32 l = 0; l < LANES; l++) sum += (W)lanes[l]; \
+		for (; i < count; i++) sum += (W)lhs[i] * (W)rhs[i]; \
+		memcpy(result, &sum, sizeof(T)); \
+	} \
+	TARGET static void prefix##_axpy(const Slot* alpha, const void* x, void* y, i64 count) { \
+		T a; \
+		memcpy(&a, alpha, sizeof(T)); \
+		const T* in = (const T*)x; \
+		T* out = (T*)y; \
+		Vector va = SET1(a); \
+		i64 i = 0; \
+		for (; i + LANES <= count; i += LANES) \
+			STORE(out + i, ADD(MUL(va, LOAD(in + i)), LOAD(out + i))); \
+		for (; i < count; i++) out[i] = (T)((W)a * (W)in[i] + (W)out[i]); \
+	} \
+	TARGET static void prefix##_scale(const Slot* factor, void* elements, i64 count) { \
+		T f; \
+		memcpy(&f, factor, sizeof(T)); \
+		T* out = (T*)elements; \
+		Vector vf = SET1(f); \
+		i64 i = 0; \
+		for (; i + LANES <= count; i += LANES) \
+			STORE(out + i, MUL(LOAD(out + i), vf)); \
+		for (; i < count; i++) out[i] = (T)((W)out[i] * (W)f); \
+	}
+
+#define DEFINE_SIMD_ARRAY_EXTREMUM(name, TARGET, T, Vector, LANES, LOAD, STORE, PICK, COMPARE) \
+	TARGET static void name(const void* elements, i64 count, Slot* result) { \
+		const T* in = (const T*)elements; \
+		T value = count > 0 ? in[0] : 0; \
+		i64 i = 1; \
+		if (count >= LANES) { \
+			Vector acc = LOAD(in); \
+			for (i = LANES; i + LANES <= count; i += LANES) \
+				acc = PICK(acc, LOAD(in + i)); \
+			T lanes[LANES]; \
+			STORE(lanes, acc); \
+			value = lanes[0]; \
+			for (i32 l = 1; l < LANES; l++) value = lanes[l] COMPARE value ? lanes[l] : value; \
+		} \
+		for (; i < count; i++) value = in[i] COMPARE value ? in[i] : value; \
+		memcpy(result, &value, sizeof(T)); \
+	}
+
+IPA_TARGET_SSE2 static inline __m128  sse2_load_f32(const f32* p)           { return _mm_loadu_ps(p); }
+IPA_TARGET_SSE2 static inline void    sse2_store_f32(f32* p, __m128 v)      { _mm_storeu_ps(p, v); }
+IPA_TARGET_SSE2 static inline __m128d sse2_load_f64(const f64* p)           { return _mm_loadu_pd(p); }
+IPA_TARGET_SSE2 static inline void    sse2_store_f64(f64* p, __m128d v)     { _mm_storeu_pd(p, v); }
+IPA_TARGET_SSE2 static inline __m128i sse2_load_s32(const i32* p)           { return _mm_loadu_si128((const __m128i*)p); }
+IPA_TARGET_SSE2 static inline void    sse2_store_s32(i32* p, __m128i v)     { _mm_storeu_si128((__m128i*)p, v); }
+
+IPA_TARGET_AVX2 static inline __m256  avx2_load_f32(const f32* p)           { return _mm256_loadu_ps(p); }
+IPA_TARGET_AVX2 static inline void    avx2_store_f32(f32* p, __m256 v)      { _mm256_storeu_ps(p, v); }
+IPA_TARGET_AVX2 static inline __m256d avx2_load_f64(const f64* p)           { return _mm256_loadu_pd(p); }
+IPA_TARGET_AVX2 static inline void    avx2_store_f64(f64* p, __m256d v)     { _mm256_storeu_pd(p, v); }
+IPA_TARGET_AVX2 static inline __m256i avx2_load_s32(const i32* p)           { return _mm256_loadu_si256((const __m256i*)p); }
+IPA_TARGET_AVX2 static inline void    avx2_store_s32(i32* p, __m256i v)     { _mm256_storeu_si256((__m256i*)p, v); }
+IPA_TARGET_AVX2 static inline __m256i avx2_load_s64(const i64* p)           { return _mm256_loadu_si256((const __m256i*)p); }
+IPA_TARGET_AVX2 static inline void    avx2_store_s64(i64* p, __m256i v)     { _mm256_storeu_si256((__m256i*)p, v); }
+
+DEFINE_SIMD_ARRAY_KERNELS(sse2_f32, IPA_TARGET_SSE2, f32, f32, __m128,  4, sse2_load_f32, sse2_store_f32, _mm_set1_ps, _mm_add_ps, _mm_mul_ps, _mm_min_ps, _mm_max_ps)
+DEFINE_SIMD_ARRAY_KERNELS(sse2_f64, IPA_TARGET_SSE2, f64, f64, __m128d, 2, sse2_load_f64, sse2_store_f64, _mm_set1_pd, _mm_add_pd, _mm_mul_pd, _mm_min_pd, _mm_max_pd)
+
+DEFINE_SIMD_ARRAY_KERNELS(avx2_f32, IPA_TARGET_AVX2, f32, f32, __m256,  8, avx2_load_f32, avx2_store_f32, _mm256_set1_ps,    _mm256_add_ps,    _mm256_mul_ps,      _mm256_min_ps,    _mm256_max_ps)
+DEFINE_SIMD_ARRAY_KERNELS(avx2_f64, IPA_TARGET_AVX2, f64, f64, __m256d, 4, avx2_load_f64, avx2_store_f64, _mm256_set1_pd,    _mm256_add_pd,    _mm256_mul_pd,      _mm256_min_pd,    _mm256_max_pd)
+DEFINE_SIMD_ARRAY_KERNELS(avx2_s32, IPA_TARGET_AVX2, i32, u32, __m256i, 8, avx2_load_s32, avx2_store_s32, _mm256_set1_epi32, _mm256_add_epi32, _mm256_mullo_epi32, _mm256_min_epi32, _mm256_max_epi32)
+
+// SSE2 lacks 32 bit lane min, max and multiply, so only the s32 sum gets a vector loop there.
+IPA_TARGET_SSE2 static void sse2_s32_sum(const void* elements, i64 count, Slot* result) {
+	const i32* in = (const i32*)elements;
+	__m128i acc0 = _mm_setzero_si128(), acc1 = _mm_setzero_si128();
+	i64 i = 0;
+	for (; i + 8 <= count; i += 8) {
+		acc0 = _mm_add_epi32(acc0, sse2_load_s32(in + i));
+		acc1 = _mm_add_epi32(acc1, sse2_load_s32(in + i + 4));
+	}
+	i32 lanes[4];
+	sse2_store_s32(lanes, _mm_add_epi32(acc0, acc1));
+	u32 sum = (u32)lanes[0] + (u32)lanes[1] + (u32)lanes[2] + (u32)lanes[3];
+	for (; i < count; i++)
+		sum += (u32)in[i];
+	result->as_u32 = sum;
+}
+
+// AVX2 has 64 bit lane adds but no 64 bit multiply, min or max.
+IPA_TARGET_AVX2 static void avx2_s64_sum(const void* elements, i64 count, Slot* result) {
+	const i64* in = (const i64*)elements;
+	__m256i acc0 = _mm256_setzero_si256(), acc1 = _mm256_setzero_si256();
+	i64 i = 0;
+	for (; i + 8 <= count; i += 8) {
+		acc0 = _mm256_add_epi64(acc0, avx2_load_s64(in + i));
+		acc1 = _mm256_add_epi64(acc1, avx2_load_s64(in + i + 4));
+	}
+	i64 lanes[4];
+	avx2_store_s64(lanes, _mm256_add_epi64(acc0, acc1));
+	u64 sum = (u64)lanes[0] + (u64)lanes[1] + (u64)lanes[2] + (u64)lanes[3];
+	for (; i < count; i++)
+		sum += (u64)in[i];
+	result->as_u64 = sum;
+}
+
+#define INSTALL_SIMD_ARRAY_KERNELS(prefix, element_index) \
+	s_reduce_kernels[0 * ELEMENT_TYPE_COUNT + element_index] = prefix##_sum; \
+	s_reduce_kernels[1 * ELEMENT_TYPE_COUNT + element_index] = prefix##_min; \
+	s_reduce_kernels[2 * ELEMENT_TYPE_COUNT + element_index] = prefix##_max; \
+	s_dot_kernels[element_index]   = prefix##_dot; \
+	s_axpy_kernels[element_index]  = prefix##_axpy; \
+	s_scale_kernels[element_index] = prefix##_scale;
+
+static void install_sse2_kernels() {
+	s_reduce_kernels[0 * ELEMENT_TYPE_COUNT + 0] = sse2_s32_sum;
+	INSTALL_SIMD_ARRAY_KERNELS(sse2_f32, 2)
+	INSTALL_SIMD_ARRAY_KERNELS(sse2_f64, 3)
+}
+
+static void install_avx2_kernels() {
+	INSTALL_SIMD_ARRAY_KERNELS(avx2_s32, 0)
+	s_reduce_kernels[0 * ELEMENT_TYPE_COUNT + 1] = avx2_s64_sum;
+	INSTALL_SIMD_ARRAY_KERNELS(avx2_f32, 2)
+	INSTALL_SIMD_ARRAY_KERNELS(avx2_f64, 3)
+}
+
+#endif // IPA_X86
+
+
+// =========================================================================================================
+// Kernel lookup
+// =========================================================================================================
+
+static bool install_kernels() {
+	install_scalar_kernels<i32>(0);
+	install_scalar_kernels<i64>(1);
+	install_scalar_kernels<f32>(2);
+	install_scalar_kernels<f64>(3);
+
+#ifdef IPA_X86
+	if (simd::cpu_features().sse2)
+		install_sse2_kernels();
+	if (simd::cpu_features().avx2)
+		install_avx2_kernels();
+#endif
+	return true;
+}
+
+static i32 get_kernel_index(OpCode opcode, OpCode first_opcode, i32 rows) {
+	static bool s_installed = install_kernels();
+	(void)s_installed;
+	i32 index = (i32)opcode - (i32)first_opcode;
+	assert(index >= 0 && index < rows * ELEMENT_TYPE_COUNT);
+	return index;
+}
+
+simd::ArrayReduceKernel simd::get_array_reduce_kernel(OpCode opcode) {
+	return s_reduce_kernels[get_kernel_index(opcode, OpCode::OpArraySumS32, 3)];
+}
+
+simd::ArrayDotKernel simd::get_array_dot_kernel(OpCode opcode) {
+	return s_dot_kernels[get_kernel_index(opcode, OpCode::OpArrayDotS32, 1)];
+}
+
+simd::ArrayAxpyKernel simd::get_array_axpy_kernel(OpCode opcode) {
+	return s_axpy_kernels[get_kernel_index(opcode, OpCode::OpArrayAxpyS32, 1)];
+}
+
+simd::ArrayScaleKernel simd::get_array_scale_kernel(OpCode opcode) {
+	return s_scale_kernels[get_kernel_index(opcode, OpCode::OpArrayScaleS32, 1)];
+}
@@ -0,0 +1,28 @@
+#ifndef ARRAY_KERNELS_H
+#define ARRAY_KERNELS_H
+#include "simd.h"
+
+
+/* \brief Whole array loops behind the sum, min, max, dot, axpy and scale built-ins.
+ * Every kernel runs over raw elements, the runtime resolves the array operands and checks their lengths.
+ * Like the vector kernels the fastest version for the running cpu is picked on first use.
+ */
+namespace simd {
+
+	// Writes the sum, minimum or maximum to result, an empty array gives zero.
+	typedef void (*ArrayReduceKernel)(const void* elements, i64 count, Slot* result);
+	// Writes the sum of a[i] * b[i] to result.
+	typedef void (*ArrayDotKernel)(const void* a, const void* b, i64 count, Slot* result);
+	// y[i] = alpha * x[i] + y[i]
+	typedef void (*ArrayAxpyKernel)(const Slot* alpha, const void* x, void* y, i64 count);
+	// elements[i] = elements[i] * factor
+	typedef void (*ArrayScaleKernel)(const Slot* factor, void* elements, i64 count);
+
+	ArrayReduceKernel get_array_reduce_kernel(OpCode opcode);
+	ArrayDotKernel get_array_dot_kernel(OpCode opcode);
+	ArrayAxpyKernel get_array_axpy_kernel(OpCode opcode);
+	ArrayScaleKernel get_array_scale_kernel(OpCode opcode);
+}
+
+
+#endif // ARRAY_KERNELS_H
@@ -35,7 +35,7 @@ void ASTPrinter::visit(ast::Variable* variable) {
 }
 
 void ASTPrinter::visit(ast::Struct* structure) {
-	indent() << structure->name.to_str() << " :: struct:";
+	indent() << structure->name.to_str() << (structure->type->is_soa() ? " :: struct (SOA):" : " :: struct:");
 	accept(structure->scope);
 }
 
@@ -77,6 +77,7 @@ void ASTPrinter::visit(ast::LoadExpr* load_expr) {
 	{	indent() << "load variable " ; print_decl_name(load_expr->loaded_decl); m_stream << " -> "; print_type(load_expr->type); }
 	else {
 		indent() << "load member "; print_decl_name(load_expr->loaded_decl); m_stream << " -> "; print_type(load_expr->type);
+		increment_indention();
 		accept(load_expr->structure_expr);
 		decrement_indention();
 	}
@@ -94,7 +95,15 @@ void ASTPrinter::visit(ast::IfStmt* expr) {
 }
 
 void ASTPrinter::visit(ast::ForStmt* stmt) {
-	indent() << "for";
+	indent() << (stmt->is_parallel ? "parallel for" : "for");
+	if (stmt->it_var) {
+		m_stream << " as " << stmt->it_var->name.to_str() << ": ";
+		print_type(stmt->it_var->type);
+	}
+	if (stmt->index_var) {
+		m_stream << ", " << stmt->index_var->name.to_str() << ": ";
+		print_type(stmt->index_var->type);
+	}
 	increment_indention();
 	if (stmt->array_expr) {
 		accept(stmt->array_expr);
@@ -184,6 +193,13 @@ void ASTPrinter::print_type(ast::Type* type) {
 	else if (type == ast::Type::GetPrimitiveOrAssert(Primitive::S64Primitive))  m_stream << "i64";
 	else if (type == ast::Type::GetPrimitiveOrAssert(Primitive::F32Primitive))  m_stream << "f32";
 	else if (type == ast::Type::GetPrimitiveOrAssert(Primitive::F64Primitive))  m_stream << "f64";
+	else if (type->is_vector()) m_stream << Token::PrimitiveToString(type->primitive());
+	else if (type->is_struct()) m_stream << static_cast<ast::StructType*>(type)->structure->name.to_str();
+	else if (type->is_array()) { m_stream << "[]"; print_type(static_cast<ast::ArrayType*>(type)->element_type); }
+	else if (type->is_channel()) {
+		ast::ChannelType* channel_type = static_cast<ast::ChannelType*>(type);
+		m_stream << "channel["; print_type(channel_type->element_type); m_stream << ", " << channel_type->capacity << "]";
+	}
 	else {
 		assert(false);
 	}
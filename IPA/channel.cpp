@@ -0,0 +1,188 @@
+#include "channel.h"
+#include "fiber.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <thread>
+
+// Failed attempts a blocking host thread spins on before it starts giving up its time slice.
+static const i32 SPIN_COUNT = 64;
+
+static u32 round_up_to_power_of_two(u32 value) {
+	u32 result = 1;
+	while (result < value) result <<= 1;
+	return result;
+}
+
+
+Channel* Channel::Create(ChannelKind kind, u32 capacity) {
+	capacity = round_up_to_power_of_two(capacity > 0 ? capacity : 1);
+	if (kind == ChannelKind::SPSC)
+		return new SpscChannel(capacity);
+	return new MpmcChannel(capacity);
+}
+
+Channel::Channel(ChannelKind kind, u32 capacity)
+	: m_capacity(capacity), m_mask(capacity - 1), m_kind(kind), m_send_waiter_count(0), m_recv_waiter_count(0) {
+	assert((capacity & (capacity - 1)) == 0);
+}
+
+bool Channel::send_or_park(Fiber* fiber, Slot value) {
+	if (!try_send(value)) {
+		park(m_send_waiters, m_send_waiter_count, fiber);
+		// A receiver may have made room before it could see us waiting, so try again before suspending.
+		if (!try_send(value))
+			return false;
+		unpark(fiber, m_send_waiters, m_send_waiter_count);
+	}
+	wake_one(m_recv_waiters, m_recv_waiter_count);
+	return true;
+}
+
+bool Channel::recv_or_park(Fiber* fiber, Slot& value) {
+	if (!try_recv(value)) {
+		park(m_recv_waiters, m_recv_waiter_count, fiber);
+		if (!try_recv(value))
+			return false;
+		unpark(fiber, m_recv_waiters, m_recv_waiter_count);
+	}
+	wake_one(m_send_waiters, m_send_waiter_count);
+	return true;
+}
+
+void Channel::send_blocking(Slot value) {
+	for (i32 attempt = 0; !try_send(value); attempt++) {
+		if (attempt >= SPIN_COUNT)
+			std::this_thread::yield();
+	}
+	wake_one(m_recv_waiters, m_recv_waiter_count);
+}
+
+Slot Channel::recv_blocking() {
+	Slot value;
+	for (i32 attempt = 0; !try_recv(value); attempt++) {
+		if (attempt >= SPIN_COUNT)
+			std::this_thread::yield();
+	}
+	wake_one(m_send_waiters, m_send_waiter_count);
+	return value;
+}
+
+void Channel::park(std::vector<Fiber*>& waiters, std::atomic<i32>& waiter_count, Fiber* fiber) {
+	std::lock_guard<std::mutex> lock(m_waiters_mutex);
+	waiters.push_back(fiber);
+	waiter_count.fetch_add(1, std::memory_order_seq_cst);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+void Channel::unpark(Fiber* fiber, std::vector<Fiber*>& waiters, std::atomic<i32>& waiter_count) {
+	std::lock_guard<std::mutex> lock(m_waiters_mutex);
+	auto waiter = std::find(waiters.begin(), waiters.end(), fiber);
+	if (waiter != waiters.end()) {
+		waiters.erase(waiter);
+		waiter_count.fetch_sub(1, std::memory_order_seq_cst);
+	}
+	// Otherwise the other end already took us off the list and woke us, the scheduler
+	// turns that early wake into an extra turn which is harmless.
+}
+
+void Channel::wake_one(std::vector<Fiber*>& waiters, std::atomic<i32>& waiter_count) {
+	// Pairs with the count increment in park, either we see the waiter or its retry sees our operation.
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (waiter_count.load(std::memory_order_relaxed) == 0)
+		return;
+
+	Fiber* fiber;
+	{
+		std::lock_guard<std::mutex> lock(m_waiters_mutex);
+		if (waiters.empty())
+			return;
+		fiber = waiters.front();
+		waiters.erase(waiters.begin());
+		waiter_count.fetch_sub(1, std::memory_order_seq_cst);
+	}
+	fiber->scheduler->wake(fiber);
+}
+
+
+SpscChannel::SpscChannel(u32 capacity)
+	: Channel(ChannelKind::SPSC, capacity), m_head(0), m_tail(0) {
+	m_slots = new Slot[capacity];
+}
+
+SpscChannel::~SpscChannel() {
+	delete[] m_slots;
+}
+
+bool SpscChannel::try_send(Slot value) {
+	u64 tail = m_tail.load(std::memory_order_relaxed);
+	if (tail - m_head.load(std::memory_order_acquire) == m_capacity)
+		return false;
+	m_slots[tail & m_mask] = value;
+	m_tail.store(tail + 1, std::memory_order_release);
+	return true;
+}
+
+bool SpscChannel::try_recv(Slot& value) {
+	u64 head = m_head.load(std::memory_order_relaxed);
+	if (head == m_tail.load(std::memory_order_acquire))
+		return false;
+	value = m_slots[head & m_mask];
+	m_head.store(head + 1, std::memory_order_release);
+	return true;
+}
+
+
+MpmcChannel::MpmcChannel(u32 capacity)
+	: Channel(ChannelKind::MPMC, capacity), m_head(0), m_tail(0) {
+	m_cells = new Cell[capacity];
+	for (u32 i = 0; i < capacity; i++)
+		m_cells[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+MpmcChannel::~MpmcChannel() {
+	delete[] m_cells;
+}
+
+bool MpmcChannel::try_send(Slot value) {
+	u64 tail = m_tail.load(std::memory_order_relaxed);
+	while (true) {
+		Cell* cell = &m_cells[tail & m_mask];
+		u64 sequence = cell->sequence.load(std::memory_order_acquire);
+		i64 difference = (i64)sequence - (i64)tail;
+		if (difference == 0) {
+			// The cell is free for this position, claim it before another sender does.
+			if (m_tail.compare_exchange_weak(tail, tail + 1, std::memory_order_relaxed)) {
+				cell->value = value;
+				cell->sequence.store(tail + 1, std::memory_order_release);
+				return true;
+			}
+		} else if (difference < 0) {
+			// Still holds the element from one lap ago, the channel is full.
+			return false;
+		} else {
+			tail = m_tail.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+bool MpmcChannel::try_recv(Slot& value) {
+	u64 head = m_head.load(std::memory_order_relaxed);
+	while (true) {
+		Cell* cell = &m_cells[head & m_mask];
+		u64 sequence = cell->sequence.load(std::memory_order_acquire);
+		i64 difference = (i64)sequence - (i64)(head + 1);
+		if (difference == 0) {
+			if (m_head.compare_exchange_weak(head, head + 1, std::memory_order_relaxed)) {
+				value = cell->value;
+				// Frees the cell for the sender one lap ahead.
+				cell->sequence.store(head + m_capacity, std::memory_order_release);
+				return true;
+			}
+		} else if (difference < 0) {
+			return false;
+		} else {
+			head = m_head.load(std::memory_order_relaxed);
+		}
+	}
+}
@@ -0,0 +1,111 @@
+#ifndef CHANNEL_H
+#define CHANNEL_H
+#include "common.h"
+#include "runtime.h"
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+class Fiber;
+
+
+enum class ChannelKind : u8 {
+	// Any number of fibers on any number of threads send and receive.
+	MPMC = 0,
+	// Exactly one sending and one receiving fiber, set with @spsc.
+	SPSC = 1,
+};
+
+/* \brief Bounded queue of slots behind the channel[T] type.
+ * Sending and receiving never take a lock while there is room or an element, only a fiber that has to
+ * wait registers itself under the waiter lock and is woken by the next operation on the other end.
+ */
+class Channel
+{
+public:
+	// The capacity is rounded up to a power of two.
+	static Channel* Create(ChannelKind kind, u32 capacity);
+	virtual ~Channel() {}
+
+	ChannelKind kind() const { return m_kind; }
+	u32 capacity() const { return m_capacity; }
+
+	virtual bool try_send(Slot value) = 0;
+	virtual bool try_recv(Slot& value) = 0;
+
+	// Used by the interpreter for OpChannelSend and OpChannelRecv. When the channel is full or empty the
+	// fiber is registered as a waiter and false is returned, the interpreter then suspends the fiber without
+	// advancing its pc and retries once the scheduler resumes it.
+	bool send_or_park(Fiber* fiber, Slot value);
+	bool recv_or_park(Fiber* fiber, Slot& value);
+
+	// For host threads that are not fibers, spins and then yields the thread until the operation succeeds.
+	void send_blocking(Slot value);
+	Slot recv_blocking();
+
+protected:
+	Channel(ChannelKind kind, u32 capacity);
+
+	u32 m_capacity;
+	u32 m_mask;
+
+private:
+	void park(std::vector<Fiber*>& waiters, std::atomic<i32>& waiter_count, Fiber* fiber);
+	void unpark(Fiber* fiber, std::vector<Fiber*>& waiters, std::atomic<i32>& waiter_count);
+	void wake_one(std::vector<Fiber*>& waiters, std::atomic<i32>& waiter_count);
+
+	ChannelKind m_kind;
+
+	std::mutex m_waiters_mutex;
+	std::vector<Fiber*> m_send_waiters;
+	std::vector<Fiber*> m_recv_waiters;
+	// Lets the other end skip the waiter lock on the fast path.
+	std::atomic<i32> m_send_waiter_count;
+	std::atomic<i32> m_recv_waiter_count;
+};
+
+/* \brief Single producer, single consumer ring. Each end owns one index and only reads the other,
+ * the indices sit on their own cache lines so the two ends do not invalidate each other on every operation.
+ */
+class SpscChannel : public Channel
+{
+public:
+	SpscChannel(u32 capacity);
+	~SpscChannel();
+
+	bool try_send(Slot value) override;
+	bool try_recv(Slot& value) override;
+
+private:
+	alignas(64) std::atomic<u64> m_head; // Next slot to read, written by the consumer.
+	alignas(64) std::atomic<u64> m_tail; // Next slot to write, written by the producer.
+	alignas(64) Slot* m_slots;
+};
+
+/* \brief Multi producer, multi consumer ring. Every cell carries a sequence number telling whether it
+ * is free for the sender claiming that position or filled for the receiver, so senders and receivers
+ * only race on their own index with a compare and swap.
+ */
+class MpmcChannel : public Channel
+{
+public:
+	MpmcChannel(u32 capacity);
+	~MpmcChannel();
+
+	bool try_send(Slot value) override;
+	bool try_recv(Slot& value) override;
+
+private:
+	struct Cell {
+		std::atomic<u64> sequence;
+		Slot value;
+	};
+
+	alignas(64) std::atomic<u64> m_head;
+	alignas(64) std::atomic<u64> m_tail;
+	alignas(64) Cell* m_cells;
+};
+
+
+#endif // CHANNEL_H
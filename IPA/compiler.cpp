@@ -3,8 +3,16 @@
 #include "project.h"
 
 #include "ast_printer.h"
+#include "opcode_printer.h"
+#include "module_cache.h"
+#include "module_graph.h"
+#include "simd.h"
+#include "source_loader.h"
+#include "thread_pool.h"
 
 
+#include <algorithm>
+#include <fstream>
 #include <iostream>
 #include <assert.h>
 
@@ -18,8 +26,7 @@ bool Link::resolve(Module* module, ast::Decl* decl) {
 		if (decl->as_or_null<ast::Struct>()) {
 			*m_target_type = decl->as_or_null<ast::Struct>()->type;
 			resolved = true;
-		} else
-			assert(false);
+		}
 	}
 	return resolved;
 }
@@ -241,10 +248,67 @@ CompilerAllocator::Block* CompilerAllocator::allocate_block(i64 size) {
 }
 
 
+static ast::Function* get_callee_or_null(ast::CallExpr* expr) {
+	ast::LoadExpr* load_expr = expr->callable->as_or_null<ast::LoadExpr>();
+	if (!load_expr || !load_expr->loaded_decl)
+		return nullptr;
+	return load_expr->loaded_decl->as_or_null<ast::Function>();
+}
+
+// Range loops count in s64 when either bound is 64 bit wide and in s32 otherwise.
+static ast::Type* get_range_type_or_null(ast::ForStmt* stmt) {
+	ast::Type* low_type = stmt->low_expr->type;
+	ast::Type* high_type = stmt->high_expr->type;
+	if (!low_type || !high_type || !low_type->is_integer() || !high_type->is_integer())
+		return nullptr;
+	bool is_64_bit = low_type->size == 8 || high_type->size == 8;
+	return ast::Type::GetPrimitiveOrAssert(is_64_bit ? Primitive::S64Primitive : Primitive::S32Primitive);
+}
+
+// The variable whose memory a store goes to, members and elements are stored through their root variable.
+static ast::Variable* get_stored_variable_or_null(ast::Expr* expr) {
+	while (expr) {
+		if (ast::ArrayAccessExpr* element = expr->as_or_null<ast::ArrayAccessExpr>()) {
+			expr = element->array_expr;
+		} else if (ast::LoadExpr* load_expr = expr->as_or_null<ast::LoadExpr>()) {
+			if (!load_expr->structure_expr)
+				return load_expr->loaded_decl ? load_expr->loaded_decl->as_or_null<ast::Variable>() : nullptr;
+			expr = load_expr->structure_expr;
+		} else {
+			return nullptr;
+		}
+	}
+	return nullptr;
+}
+
+// Whether a store goes to an array element, or a member of one, rather than to a variable or its members.
+static bool is_element_store(ast::Expr* expr) {
+	while (ast::LoadExpr* load_expr = expr ? expr->as_or_null<ast::LoadExpr>() : nullptr)
+		expr = load_expr->structure_expr;
+	return expr && expr->as_or_null<ast::ArrayAccessExpr>();
+}
+
+// The array kernels exist for s32, s64, f32 and f64 elements, in that order.
+static i32 get_kernel_element_index_or_minus_one(ast::Type* element_type) {
+	switch (element_type ? element_type->primitive() : Primitive::NoPrimitive) {
+	case(Primitive::S32Primitive): return 0;
+	case(Primitive::S64Primitive): return 1;
+	case(Primitive::F32Primitive): return 2;
+	case(Primitive::F64Primitive): return 3;
+	default:
+		return -1;
+	}
+}
+
+
 void TypeInferer::infer_types() {
 	visit(m_module_compiler->scope());
 }
 
+void TypeInferer::infer_lazy_body(ast::Function* function) {
+	accept(function->body);
+}
+
 bool TypeInferer::mark_visited(ast::Node* node) {
 	if (node->been_visited)
 		return true;
@@ -268,6 +332,7 @@ void TypeInferer::visit(ast::Scope* scope) {
 void TypeInferer::visit(ast::Variable* variable) {
 	if (mark_visited(variable))
 		return; 
+	variable->type = resolve_type(variable->type);
 	accept(variable->default_value);
 	if (!variable->type)
 		variable->type = variable->default_value->type;
@@ -276,11 +341,45 @@ void TypeInferer::visit(ast::Variable* variable) {
 void TypeInferer::visit(ast::Struct* structure) {
 	if (mark_visited(structure))
 		return;
+
+	bool is_soa = (structure->decl_flags & ast::Decl::SOA) == ast::Decl::SOA;
+	u32 size = 0;
+	u32 structure_alignment = 1;
+	for (i32 i = 0; i < structure->scope->declerations_count; i++) {
+		ast::Variable* member = structure->scope->declerations[i]->as_or_null<ast::Variable>();
+		if (!member || (member->decl_flags & ast::Decl::MEMBER) != ast::Decl::MEMBER)
+			continue;
+		accept(member);
+		if (!member->type)
+			continue;
+		// Every member of a soa struct gets a column of its own, element loads only exist for scalars.
+		if (is_soa && (member->type->is_struct() || member->type->is_vector() || member->type->is_array() || member->type->is_channel())) {
+			m_module_compiler->raise_error()
+				->message("Members of @soa structs have to be scalars, '")->message(member->name.to_str())->message("' is not: ")
+				->highlight_token(member->name);
+		}
+		// The largest power of two dividing the size, a padded struct is a multiple of its own alignment.
+		u32 alignment = member->type->size & (~member->type->size + 1);
+		if (alignment == 0)
+			alignment = 1;
+		else if (alignment > 8)
+			alignment = 8;
+		if (alignment > 1)
+			size = (size + alignment - 1) & ~(alignment - 1);
+		if (alignment > structure_alignment)
+			structure_alignment = alignment;
+		size += member->type->size;
+	}
+	// Tail padding, so every element of an array of the struct keeps its members aligned.
+	structure->type->size = (size + structure_alignment - 1) & ~(structure_alignment - 1);
 }
 
 void TypeInferer::visit(ast::Function* function) {
 	if (mark_visited(function))
 		return; 
+	for (i32 i = 0; i < function->arguments_count; i++)
+		function->arguments[i]->type = resolve_type(function->arguments[i]->type);
+	function->return_type = resolve_type(function->return_type);
 	accept(function->body);
 }
 
@@ -288,6 +387,10 @@ void TypeInferer::visit(ast::Block* block) {
 	if (mark_visited(block))
 		return; 
 	accept(block->scope);
+	for (i32 i = 0; i < block->local_variables_count; i++)
+		accept(block->local_variables[i]);
+	if (m_parallel_loop_depth > 0)
+		m_parallel_loop_locals.insert(m_parallel_loop_locals.end(), block->local_variables, block->local_variables + block->local_variables_count);
 	for (i32 i = 0; i < block->statements_count; i++)
 		accept(block->statements[i]);
 }
@@ -304,6 +407,30 @@ void TypeInferer::visit(ast::LoadExpr* expr) {
 			expr->type = ast::Type::GetPrimitiveOrAssert(Primitive::BoolPrimitive);
 		else
 			assert(false);
+	} else if (expr->structure_expr) {
+		accept(expr->structure_expr);
+		ast::Type* structure_type = expr->structure_expr->type;
+		if (structure_type && structure_type->is_struct()) {
+			ast::Struct* structure = static_cast<ast::StructType*>(structure_type)->structure;
+			ast::Decl* member = structure->scope->get_decleration_or_null(expr->member_name);
+			if (member && member->as_or_null<ast::Variable>()) {
+				ast::Variable* var = member->as_or_assert<ast::Variable>();
+				if (!var->type)
+					jump_to(var);
+				expr->loaded_decl = var;
+				expr->type = var->type;
+			} else {
+				m_module_compiler->raise_error()
+					->message("'")->message(expr->member_name.to_str())->message("' is not a member of '")->message(structure->name.to_str())->message("': ")
+					->highlight_token(expr->member_name);
+			}
+		} else if (structure_type) {
+			m_module_compiler->raise_error()
+				->message("'")->message(expr->member_name.to_str())->message("' can only be loaded from a struct: ")
+				->highlight_token(expr->member_name);
+		}
+	} else if (ast::Function* function = expr->loaded_decl->as_or_null<ast::Function>()) {
+		expr->type = function->type;
 	} else if (ast::Variable* var = expr->loaded_decl->as_or_assert<ast::Variable>()) {
 		if (!var->type)
 			jump_to(var);
@@ -312,12 +439,71 @@ void TypeInferer::visit(ast::LoadExpr* expr) {
 		assert(false);
 }
 
+void TypeInferer::visit(ast::IfStmt* stmt) {
+	if (mark_visited(stmt))
+		return;
+	accept(stmt->condition);
+	accept(stmt->true_block);
+	accept(stmt->false_block);
+}
+
+void TypeInferer::visit(ast::ForStmt* stmt) {
+	if (mark_visited(stmt))
+		return;
+	if (stmt->array_expr) {
+		accept(stmt->array_expr);
+		ast::Type* array_type = stmt->array_expr->type;
+		if (array_type && array_type->is_array()) {
+			if (stmt->it_var)
+				stmt->it_var->type = static_cast<ast::ArrayType*>(array_type)->element_type;
+			if (stmt->index_var)
+				stmt->index_var->type = ast::Type::GetPrimitiveOrAssert(Primitive::S64Primitive);
+		}
+	} else {
+		accept(stmt->low_expr);
+		accept(stmt->high_expr);
+		ast::Type* range_type = get_range_type_or_null(stmt);
+		if (!range_type) {
+			m_module_compiler->raise_error()
+				->message("The bounds of a range loop have to be integers. ");
+		} else if (stmt->it_var) {
+			stmt->it_var->type = range_type;
+		}
+	}
+	if (stmt->is_parallel) {
+		size_t outer_first_local = m_parallel_loop_first_local;
+		m_parallel_loop_first_local = m_parallel_loop_locals.size();
+		m_parallel_loop_locals.push_back(stmt->it_var);
+		m_parallel_loop_locals.push_back(stmt->index_var);
+		++m_parallel_loop_depth;
+		accept(stmt->block);
+		--m_parallel_loop_depth;
+		m_parallel_loop_locals.resize(m_parallel_loop_first_local);
+		m_parallel_loop_first_local = outer_first_local;
+	} else {
+		accept(stmt->block);
+	}
+}
+
+void TypeInferer::visit(ast::WhileStmt* stmt) {
+	if (mark_visited(stmt))
+		return;
+	accept(stmt->condition);
+	accept(stmt->loop_body);
+}
+
 void TypeInferer::visit(ast::ReturnStmt* stmt) {
 	if (mark_visited(stmt))
 		return;
 	accept(stmt->return_value);
 }
 
+void TypeInferer::visit(ast::ExprStmt* stmt) {
+	if (mark_visited(stmt))
+		return;
+	accept(stmt->expr);
+}
+
 void TypeInferer::visit(ast::OperandExpr* expr) {
 	if (mark_visited(expr))
 		return; 
@@ -336,9 +522,37 @@ void TypeInferer::visit(ast::OperandExpr* expr) {
 		// Evaluate lhs for storing and also read it in.
 	}
 
+	bool is_store = expr->operand == Operand::SetOperand ||
+		expr->operand == Operand::AddSetOperand || expr->operand == Operand::SubSetOperand ||
+		expr->operand == Operand::MulSetOperand || expr->operand == Operand::DivSetOperand ||
+		expr->operand == Operand::ModSetOperand ||
+		expr->operand == Operand::IncrementOperand || expr->operand == Operand::DecrementOperand;
+	if (is_store && m_parallel_loop_depth > 0) {
+		// Iterations of a parallel loop run at the same time, shared state would be a data race. Only elements
+		// of arrays declared outside can be written, iterations are expected to each write their own.
+		ast::Variable* variable = get_stored_variable_or_null(expr->lhs);
+		if (variable && (variable->decl_flags & ast::Decl::GLOBAL)) {
+			m_module_compiler->raise_error()
+				->message("The body of a @parallel loop can not write to the global '")->message(variable->name.to_str())
+				->message("', use the atomic built-ins instead. Declared here:")
+				->highlight_token(variable->name);
+		} else if (variable && !is_element_store(expr->lhs) && !is_declared_in_parallel_loop(variable)) {
+			m_module_compiler->raise_error()
+				->message("The body of a @parallel loop can only write to variables declared inside it, '")->message(variable->name.to_str())
+				->message("' is declared outside. Declared here:")
+				->highlight_token(variable->name);
+		}
+	}
+
 	accept(expr->lhs);
 	accept(expr->rhs);
 
+	if ((expr->lhs && expr->lhs->type && expr->lhs->type->is_vector()) ||
+		(expr->rhs && expr->rhs->type && expr->rhs->type->is_vector())) {
+		infer_vector_operand_expr(expr);
+		return;
+	}
+
 	if (expr->lhs->type == expr->rhs->type)
 		expr->type = expr->lhs->type;
 	else {
@@ -354,12 +568,416 @@ void TypeInferer::visit(ast::OperandExpr* expr) {
 	}
 }
 
+void TypeInferer::infer_vector_operand_expr(ast::OperandExpr* expr) {
+	// Lanes are never converted or broadcast, both sides have to be the same vector.
+	if (!expr->lhs || !expr->rhs || expr->lhs->type != expr->rhs->type) {
+		m_module_compiler->raise_error()
+			->message("Both operands of a vector operation have to have the same vector type. ")
+			->highlight_token(expr->token);
+		return;
+	}
+
+	ast::Type* type = expr->lhs->type;
+	switch (expr->operand) {
+	case(Operand::SetOperand):
+	case(Operand::AddOperand): case(Operand::SubOperand): case(Operand::MulOperand):
+	case(Operand::LtOperand): case(Operand::GtOperand): case(Operand::EqualsOperand):
+		break;
+	case(Operand::DivOperand):
+		if (type->get_lane_type_or_null()->is_integer()) {
+			m_module_compiler->raise_error()
+				->message("Integer vectors can not be divided. ")
+				->highlight_token(expr->token);
+			return;
+		}
+		break;
+	default:
+		m_module_compiler->raise_error()
+			->message("Vectors only support the operators + - * / < > and ==, not '")->message(Token::OperandToString(expr->operand))->message("'. ")
+			->highlight_token(expr->token);
+		return;
+	}
+	expr->type = type;
+}
+
+bool TypeInferer::is_declared_in_parallel_loop(ast::Variable* variable) const {
+	for (size_t i = m_parallel_loop_first_local; i < m_parallel_loop_locals.size(); i++) {
+		if (m_parallel_loop_locals[i] == variable)
+			return true;
+	}
+	return false;
+}
+
 void TypeInferer::visit(ast::CallExpr* expr) {
 	if (mark_visited(expr))
 		return;
 	accept(expr->callable);
 	for (i32 i = 0; i < expr->arguments_count; i++)
 		accept(expr->arguments[i]);
+
+	ast::Function* callee = get_callee_or_null(expr);
+	if (callee && callee->intrinsic != Intrinsic::NoIntrinsic)
+		infer_intrinsic_call(expr, callee->intrinsic);
+	else if (callee)
+		expr->type = callee->return_type;
+}
+
+bool TypeInferer::coerce_to_type(ast::Expr* expr, ast::Type* type) {
+	ast::LoadExpr* constant = expr->as_or_null<ast::LoadExpr>();
+	if (constant && constant->constant.is(TokenType::NumberToken))
+		constant->type = type;
+	return expr->type == type;
+}
+
+void TypeInferer::infer_intrinsic_call(ast::CallExpr* expr, Intrinsic intrinsic) {
+	if (intrinsic >= Intrinsic::IoReadIntrinsic) {
+		infer_io_intrinsic_call(expr, intrinsic);
+		return;
+	}
+	if (intrinsic >= Intrinsic::ParallelSumIntrinsic) {
+		infer_parallel_intrinsic_call(expr, intrinsic);
+		return;
+	}
+	if (intrinsic >= Intrinsic::AtomicLoadIntrinsic) {
+		infer_atomic_intrinsic_call(expr, intrinsic);
+		return;
+	}
+	if (intrinsic >= Intrinsic::SendIntrinsic) {
+		infer_channel_intrinsic_call(expr, intrinsic);
+		return;
+	}
+	if (intrinsic >= Intrinsic::SumIntrinsic) {
+		infer_array_intrinsic_call(expr, intrinsic);
+		return;
+	}
+
+	ast::Type* vector_type = expr->arguments_count > 0 ? expr->arguments[0]->type : nullptr;
+	if (!vector_type || !vector_type->is_vector()) {
+		m_module_compiler->raise_error()
+			->message("The first argument of a vector built-in has to be a vector. ")
+			->highlight_token(expr->token);
+		return;
+	}
+
+	switch (intrinsic) {
+	case(Intrinsic::ShuffleIntrinsic): {
+		if (vector_type->lane_count() != 4 || vector_type->get_lane_type_or_null()->size != 4 || expr->arguments_count != 5) {
+			m_module_compiler->raise_error()
+				->message("shuffle takes a f32x4 or s32x4 vector followed by four lane indices. ")
+				->highlight_token(expr->token);
+			return;
+		}
+		for (i32 i = 1; i < expr->arguments_count; i++) {
+			ast::LoadExpr* lane = expr->arguments[i]->as_or_null<ast::LoadExpr>();
+			if (!lane || !lane->constant.is(TokenType::NumberToken) || lane->constant.length() != 1 ||
+				lane->constant.first_char_ptr()[0] < '0' || lane->constant.first_char_ptr()[0] > '3') {
+				m_module_compiler->raise_error()
+					->message("The lane indices of shuffle have to be constants between 0 and 3. ")
+					->highlight_token(expr->token);
+				return;
+			}
+		}
+		expr->type = vector_type;
+	} break;
+	case(Intrinsic::ReduceAddIntrinsic):
+	case(Intrinsic::ReduceMinIntrinsic):
+	case(Intrinsic::ReduceMaxIntrinsic):
+		if (expr->arguments_count != 1) {
+			m_module_compiler->raise_error()
+				->message("Vector reductions take exactly one argument. ")
+				->highlight_token(expr->token);
+			return;
+		}
+		expr->type = vector_type->get_lane_type_or_null();
+		break;
+	default:
+		assert(false);
+		break;
+	}
+}
+
+void TypeInferer::infer_array_intrinsic_call(ast::CallExpr* expr, Intrinsic intrinsic) {
+	// Which arguments are arrays and which is the scalar, -1 when there is no scalar.
+	i32 arguments_count, scalar_index;
+	switch (intrinsic) {
+	case(Intrinsic::SumIntrinsic):
+	case(Intrinsic::MinIntrinsic):
+	case(Intrinsic::MaxIntrinsic):   arguments_count = 1; scalar_index = -1; break;
+	case(Intrinsic::DotIntrinsic):   arguments_count = 2; scalar_index = -1; break;
+	case(Intrinsic::AxpyIntrinsic):  arguments_count = 3; scalar_index = 0;  break;
+	case(Intrinsic::ScaleIntrinsic): arguments_count = 2; scalar_index = 1;  break;
+	default:
+		assert(false);
+		return;
+	}
+
+	if (expr->arguments_count != arguments_count) {
+		m_module_compiler->raise_error()
+			->message("Built-in takes ")->message(std::to_string(arguments_count))
+			->message(" arguments, got ")->message(std::to_string(expr->arguments_count))->message(". ")
+			->highlight_token(expr->token);
+		return;
+	}
+
+	ast::Type* element_type = nullptr;
+	for (i32 i = 0; i < arguments_count; i++) {
+		if (i == scalar_index)
+			continue;
+		ast::Type* type = expr->arguments[i]->type;
+		if (!type || !type->is_array() || get_kernel_element_index_or_minus_one(static_cast<ast::ArrayType*>(type)->element_type) < 0) {
+			m_module_compiler->raise_error()
+				->message("Array built-ins take arrays of s32, s64, f32 or f64. ")
+				->highlight_token(expr->token);
+			return;
+		}
+		ast::Type* array_element_type = static_cast<ast::ArrayType*>(type)->element_type;
+		if (element_type && element_type != array_element_type) {
+			m_module_compiler->raise_error()
+				->message("The arrays passed to a built-in have to share their element type. ")
+				->highlight_token(expr->token);
+			return;
+		}
+		element_type = array_element_type;
+	}
+
+	if (scalar_index >= 0 && !coerce_to_type(expr->arguments[scalar_index], element_type)) {
+		m_module_compiler->raise_error()
+			->message("The scalar argument has to match the element type of the array. ")
+			->highlight_token(expr->token);
+		return;
+	}
+
+	switch (intrinsic) {
+	case(Intrinsic::SumIntrinsic):
+	case(Intrinsic::MinIntrinsic):
+	case(Intrinsic::MaxIntrinsic):
+	case(Intrinsic::DotIntrinsic):
+		expr->type = element_type;
+		break;
+	default:
+		// axpy and scale write into their array operand.
+		expr->type = ast::Type::GetPrimitiveOrAssert(Primitive::VoidPrimitive);
+		break;
+	}
+}
+
+void TypeInferer::infer_channel_intrinsic_call(ast::CallExpr* expr, Intrinsic intrinsic) {
+	i32 arguments_count = intrinsic == Intrinsic::SendIntrinsic ? 2 : 1;
+	if (expr->arguments_count != arguments_count) {
+		m_module_compiler->raise_error()
+			->message("Built-in takes ")->message(std::to_string(arguments_count))
+			->message(" arguments, got ")->message(std::to_string(expr->arguments_count))->message(". ");
+		return;
+	}
+
+	ast::Type* channel_type = expr->arguments[0]->type;
+	if (!channel_type || !channel_type->is_channel()) {
+		m_module_compiler->raise_error()
+			->message("The first argument of send and recv has to be a channel. ");
+		return;
+	}
+	ast::Type* element_type = static_cast<ast::ChannelType*>(channel_type)->element_type;
+
+	if (intrinsic == Intrinsic::RecvIntrinsic) {
+		expr->type = element_type;
+		return;
+	}
+
+	if (!coerce_to_type(expr->arguments[1], element_type)) {
+		m_module_compiler->raise_error()
+			->message("The value sent has to match the element type of the channel. ");
+		return;
+	}
+	expr->type = ast::Type::GetPrimitiveOrAssert(Primitive::VoidPrimitive);
+}
+
+void TypeInferer::infer_atomic_intrinsic_call(ast::CallExpr* expr, Intrinsic intrinsic) {
+	i32 arguments_count;
+	switch (intrinsic) {
+	case(Intrinsic::AtomicLoadIntrinsic):  arguments_count = 1; break;
+	case(Intrinsic::AtomicStoreIntrinsic):
+	case(Intrinsic::AtomicAddIntrinsic):   arguments_count = 2; break;
+	case(Intrinsic::AtomicCasIntrinsic):   arguments_count = 3; break;
+	default:
+		assert(false);
+		return;
+	}
+
+	if (expr->arguments_count != arguments_count) {
+		m_module_compiler->raise_error()
+			->message("Built-in takes ")->message(std::to_string(arguments_count))
+			->message(" arguments, got ")->message(std::to_string(expr->arguments_count))->message(". ")
+			->highlight_token(expr->token);
+		return;
+	}
+
+	// Only globals and struct members have an address other threads can see.
+	ast::LoadExpr* target = expr->arguments[0]->as_or_null<ast::LoadExpr>();
+	ast::Variable* variable = target && target->loaded_decl ? target->loaded_decl->as_or_null<ast::Variable>() : nullptr;
+	if (!variable || !(variable->decl_flags & (ast::Decl::GLOBAL | ast::Decl::MEMBER))) {
+		m_module_compiler->raise_error()
+			->message("The first argument of an atomic built-in has to be a global variable or a struct member. ")
+			->highlight_token(expr->token);
+		return;
+	}
+	if (variable->decl_flags & ast::Decl::CONST) {
+		m_module_compiler->raise_error()
+			->message("Atomic built-ins can not be used on the constant '")->message(variable->name.to_str())
+			->message("', declared here:")
+			->highlight_token(variable->name);
+		return;
+	}
+	ast::ArrayAccessExpr* element = target->structure_expr ? target->structure_expr->as_or_null<ast::ArrayAccessExpr>() : nullptr;
+	if (element && element->type && element->type->is_struct() && static_cast<ast::StructType*>(element->type)->is_soa()) {
+		m_module_compiler->raise_error()
+			->message("Atomic built-ins can not be used on members of @soa structs. ")
+			->highlight_token(target->member_name);
+		return;
+	}
+
+	ast::Type* type = target->type;
+	Primitive primitive = type ? type->primitive() : Primitive::NoPrimitive;
+	if (!type || type->is_vector() || (primitive != Primitive::S32Primitive && primitive != Primitive::U32Primitive &&
+		primitive != Primitive::S64Primitive && primitive != Primitive::U64Primitive)) {
+		m_module_compiler->raise_error()
+			->message("Atomic built-ins only work on s32, u32, s64 and u64 variables. ")
+			->highlight_token(expr->token);
+		return;
+	}
+
+	for (i32 i = 1; i < expr->arguments_count; i++) {
+		if (!coerce_to_type(expr->arguments[i], type)) {
+			m_module_compiler->raise_error()
+				->message("The operands of an atomic built-in have to match the type of the variable. ")
+				->highlight_token(expr->token);
+			return;
+		}
+	}
+
+	switch (intrinsic) {
+	case(Intrinsic::AtomicStoreIntrinsic):
+		expr->type = ast::Type::GetPrimitiveOrAssert(Primitive::VoidPrimitive);
+		break;
+	case(Intrinsic::AtomicCasIntrinsic):
+		expr->type = ast::Type::GetPrimitiveOrAssert(Primitive::BoolPrimitive);
+		break;
+	default:
+		// atomic_add gives back the value from before the addition.
+		expr->type = type;
+		break;
+	}
+}
+
+void TypeInferer::infer_parallel_intrinsic_call(ast::CallExpr* expr, Intrinsic intrinsic) {
+	// parallel_sum(map, low, high) and parallel_sum(map, array),
+	// parallel_reduce(combine, identity, low, high) and parallel_reduce(combine, identity, array).
+	bool is_reduce = intrinsic == Intrinsic::ParallelReduceIntrinsic;
+	i32 elements_index = is_reduce ? 2 : 1;
+	if (expr->arguments_count != elements_index + 1 && expr->arguments_count != elements_index + 2) {
+		m_module_compiler->raise_error()
+			->message(is_reduce ? "parallel_reduce takes a function, the identity and a range or an array. " :
+				"parallel_sum takes a function and a range or an array. ");
+		return;
+	}
+
+	ast::LoadExpr* function_expr = expr->arguments[0]->as_or_null<ast::LoadExpr>();
+	ast::Function* function = function_expr && function_expr->loaded_decl ? function_expr->loaded_decl->as_or_null<ast::Function>() : nullptr;
+	if (!function || function->intrinsic != Intrinsic::NoIntrinsic) {
+		m_module_compiler->raise_error()
+			->message("The first argument of a parallel built-in has to be a function. ");
+		return;
+	}
+
+	ast::Type* element_type;
+	bool is_range = expr->arguments_count == elements_index + 2;
+	if (is_range) {
+		ast::Type* low_type = expr->arguments[elements_index]->type;
+		ast::Type* high_type = expr->arguments[elements_index + 1]->type;
+		if (!low_type || !high_type || !low_type->is_integer() || !high_type->is_integer()) {
+			m_module_compiler->raise_error()
+				->message("The bounds of a parallel range have to be integers. ");
+			return;
+		}
+		// Same rule as range loops.
+		bool is_64_bit = low_type->size == 8 || high_type->size == 8;
+		element_type = ast::Type::GetPrimitiveOrAssert(is_64_bit ? Primitive::S64Primitive : Primitive::S32Primitive);
+	} else {
+		ast::Type* array_type = expr->arguments[elements_index]->type;
+		if (!array_type || !array_type->is_array()) {
+			m_module_compiler->raise_error()
+				->message("Parallel built-ins take either a range or an array. ");
+			return;
+		}
+		element_type = static_cast<ast::ArrayType*>(array_type)->element_type;
+	}
+
+	ast::Type* result_type = function->return_type;
+	if (!is_reduce) {
+		// The map function runs once per element, the results are added up.
+		if (function->arguments_count != 1 || function->arguments[0]->type != element_type) {
+			m_module_compiler->raise_error()
+				->message("The function passed to parallel_sum has to take exactly one argument of the element type. ");
+			return;
+		}
+		if (get_kernel_element_index_or_minus_one(result_type) < 0) {
+			m_module_compiler->raise_error()
+				->message("The function passed to parallel_sum has to return s32, s64, f32 or f64. ");
+			return;
+		}
+	} else {
+		// Partials are combined in no particular order, so the elements have to be partials themselves.
+		if (function->arguments_count != 2 || function->arguments[0]->type != element_type ||
+			function->arguments[1]->type != element_type || result_type != element_type) {
+			m_module_compiler->raise_error()
+				->message("The function passed to parallel_reduce has to combine two elements into one of the same type. ");
+			return;
+		}
+		ast::Expr* identity = expr->arguments[1];
+		ast::LoadExpr* constant = identity->as_or_null<ast::LoadExpr>();
+		if (constant && constant->constant.is(TokenType::NumberToken))
+			constant->type = element_type;
+		if (identity->type != element_type) {
+			m_module_compiler->raise_error()
+				->message("The identity of parallel_reduce has to match the element type. ");
+			return;
+		}
+	}
+	expr->type = result_type;
+}
+
+void TypeInferer::infer_io_intrinsic_call(ast::CallExpr* expr, Intrinsic intrinsic) {
+	// io_read(fd, buffer) and io_write(fd, buffer) return the byte count or a negative errno, io_close(fd) 0 or a negative errno.
+	i32 arguments_count = intrinsic == Intrinsic::IoCloseIntrinsic ? 1 : 2;
+	if (expr->arguments_count != arguments_count) {
+		m_module_compiler->raise_error()
+			->message("Built-in takes ")->message(std::to_string(arguments_count))
+			->message(" arguments, got ")->message(std::to_string(expr->arguments_count))->message(". ")
+			->highlight_token(expr->token);
+		return;
+	}
+
+	ast::Type* fd_type = expr->arguments[0]->type;
+	if (!fd_type || fd_type->primitive() != Primitive::S32Primitive || fd_type->is_vector()) {
+		m_module_compiler->raise_error()
+			->message("File descriptors are passed as s32. ")
+			->highlight_token(expr->token);
+		return;
+	}
+
+	if (intrinsic == Intrinsic::IoCloseIntrinsic) {
+		expr->type = ast::Type::GetPrimitiveOrAssert(Primitive::S32Primitive);
+		return;
+	}
+
+	ast::Type* buffer_type = expr->arguments[1]->type;
+	if (!buffer_type || !buffer_type->is_array() ||
+		static_cast<ast::ArrayType*>(buffer_type)->element_type != ast::Type::GetPrimitiveOrAssert(Primitive::U8Primitive)) {
+		m_module_compiler->raise_error()
+			->message("io_read and io_write take their buffer as an array of u8. ")
+			->highlight_token(expr->token);
+		return;
+	}
+	expr->type = ast::Type::GetPrimitiveOrAssert(Primitive::S64Primitive);
 }
 
 void TypeInferer::visit(ast::ArrayAccessExpr* expr) {
@@ -367,6 +985,8 @@ void TypeInferer::visit(ast::ArrayAccessExpr* expr) {
 		return;
 	accept(expr->array_expr);
 	accept(expr->index_expr);
+	if (expr->array_expr->type && expr->array_expr->type->is_array())
+		expr->type = static_cast<ast::ArrayType*>(expr->array_expr->type)->element_type;
 }
 
 void TypeInferer::visit(ast::CastExpr* expr) {
@@ -375,6 +995,34 @@ void TypeInferer::visit(ast::CastExpr* expr) {
 	accept(expr);
 }
 
+ast::Type* TypeInferer::resolve_type(ast::Type* type) {
+	if (!type)
+		return nullptr;
+	if (type->is_unresolved()) {
+		ast::UnresolvedType* unresolved = static_cast<ast::UnresolvedType*>(type);
+		if (!unresolved->resolved_type) {
+			m_module_compiler->raise_error()
+				->message("Unknown type '")->message(unresolved->name.to_str())->message("', used here:")
+				->highlight_token(unresolved->name);
+		}
+		return unresolved->resolved_type;
+	}
+	if (type->is_array()) {
+		ast::ArrayType* array_type = static_cast<ast::ArrayType*>(type);
+		array_type->element_type = resolve_type(array_type->element_type);
+	}
+	if (type->is_channel()) {
+		ast::ChannelType* channel_type = static_cast<ast::ChannelType*>(type);
+		channel_type->element_type = resolve_type(channel_type->element_type);
+		// Elements travel through the channel as single slots.
+		if (channel_type->element_type && (channel_type->element_type->is_vector() || channel_type->element_type->is_struct())) {
+			m_module_compiler->raise_error()
+				->message("Channels can only carry scalars and references, structs have to be sent as arrays. ");
+		}
+	}
+	return type;
+}
+
 
 ModuleCompiler* ModuleCompiler::Create(Compiler* compiler, Module* module) {
 	ModuleCompiler* memory = compiler->allocator()->allocate_one<ModuleCompiler>();
@@ -382,40 +1030,117 @@ ModuleCompiler* ModuleCompiler::Create(Compiler* compiler, Module* module) {
 }
 
 ModuleCompiler::ModuleCompiler(Module* module, Compiler* compiler)
-	: m_source(module->path()) {
+	: m_source(module->path(), false) {
 	m_scope = ast::Scope::Create(&m_allocator, compiler->global_scope());
 	m_module = module;
 	m_compiler = compiler;
 }
 
+Tokenizer* ModuleCompiler::create_tokenizer(bool keep_tokens) {
+	assert(!m_tokenizer);
+	m_tokenizer = m_allocator.allocate_one<Tokenizer>();
+	new (m_tokenizer)(Tokenizer)(this, keep_tokens);
+	return m_tokenizer;
+}
+
 void ModuleCompiler::parse_and_link_internals() {
+	bool lazy_bodies = m_module->project()->settings().lazy_bodies;
+	if (!m_tokenizer)
+		create_tokenizer(lazy_bodies);
 	{
-		Parser parser(this);
+		Parser parser(this, *m_tokenizer);
 		parser.parse();
 	}
+	m_is_parsed = true;
+	link_internals(0);
 
-	for (i32 i = 0; i < m_unresolved_links.size(); i++) {
+	if (!lazy_bodies) {
+		m_tokenizer->~Tokenizer();
+		m_tokenizer = nullptr;
+	}
+}
+
+void ModuleCompiler::link_internals(i32 first_link) {
+	for (i32 i = first_link; i < m_unresolved_links.size(); i++) {
 		bool found = false;
 		Link* link = &m_unresolved_links[i];
 		ast::Scope* scope = link->m_scope;
 		while (scope && !found) {
 			ast::Decl* decl = scope->get_decleration_or_null(link->m_identifier);
+			// The innermost declaration wins, whether or not it is something the link can point at.
 			if (decl) {
-				if (!link->resolve(m_module, decl)) {
-					m_compiler->add_link(link);
-					found = true;
-				}
+				if (!link->resolve(m_module, decl))
+					m_external_links.push_back(link);
+				found = true;
 			}
 			scope = scope->parent;
 		}
 		if (!found)
-			m_compiler->add_link(link);
+			m_external_links.push_back(link);
 	}
 }
 
 void ModuleCompiler::infer_types_and_do_semantic_analysis() {
 	TypeInferer analyser(this);
 	analyser.infer_types();
+	m_is_analyzed = true;
+}
+
+ModuleCompiler::~ModuleCompiler() {
+	for (auto function_code : m_function_codes)
+		delete function_code;
+	if (m_tokenizer)
+		m_tokenizer->~Tokenizer();
+}
+
+const FunctionCode* ModuleCompiler::compile_function(ast::Function* function) {
+	std::lock_guard<std::mutex> lock(m_functions_mutex);
+	if (const FunctionCode* code = function->code.load(std::memory_order_relaxed))
+		return code;
+	if (function->lazy_body_token >= 0 && !parse_lazy_body(function))
+		return nullptr;
+	if (!function->body)
+		return nullptr;
+
+	FunctionCompiler compiler(function);
+	compiler.compile();
+	FunctionCode* code = new FunctionCode();
+	code->code.swap(compiler.code());
+	code->slot_count = compiler.slot_count();
+	m_function_codes.push_back(code);
+
+	function->code.store(code, std::memory_order_release);
+	return code;
+}
+
+bool ModuleCompiler::parse_lazy_body(ast::Function* function) {
+	size_t error_count = m_errors.size();
+	i32 first_link = (i32)m_unresolved_links.size();
+	{
+		Parser parser(this, *m_tokenizer);
+		parser.parse_lazy_body(function);
+	}
+	// Links of the body that stay unresolved go through the imports, like they would have at link time.
+	link_internals(first_link);
+	link_externals();
+
+	if (m_errors.size() == error_count) {
+		TypeInferer analyser(this);
+		analyser.infer_lazy_body(function);
+	}
+	if (m_errors.size() != error_count) {
+		// A broken body is never compiled, later calls find neither a body nor one to parse.
+		function->body = nullptr;
+		return false;
+	}
+	return true;
+}
+
+void ModuleCompiler::reset() {
+	Module* module = m_module;
+	Compiler* compiler = m_compiler;
+	this->~ModuleCompiler();
+	new (this)(ModuleCompiler)(module, compiler);
 }
 
 void ModuleCompiler::add_link(ast::LoadExpr* load_expr, ast::Scope* scope, const Token& name) {
@@ -426,16 +1151,69 @@ void ModuleCompiler::add_link(ast::LoadExpr* load_expr, ast::Scope* scope, const
 	m_unresolved_links.push_back(link);
 }
 
-void ModuleCompiler::import(Module* module, const Token& as) {
+void ModuleCompiler::add_link(ast::UnresolvedType* type, ast::Scope* scope) {
+	Link link = { 0 };
+	link.m_target_type = &type->resolved_type;
+	link.m_identifier = type->name;
+	link.m_scope = scope;
+	m_unresolved_links.push_back(link);
+}
 
+void ModuleCompiler::import(Module* module, const Token& as) {
+	// Only the edge is recorded, declarations are reached through from-imports.
+	add_dependency(module);
 }
 
 void ModuleCompiler::import_from(Module* module, const Token& identifier, const Token& as) {
-
+	add_dependency(module);
+	m_imports.push_back({ module, identifier, as });
 }
 
 void ModuleCompiler::import_everything(Module* module) {
+	add_dependency(module);
+	m_imports.push_back({ module, Token(), Token() });
+}
+
+void ModuleCompiler::link_imports() {
+	for (auto& import : m_imports) {
+		ModuleCompiler* imported = m_compiler->module_compiler_or_null(import.module);
+		if (import.identifier && !imported->scope()->get_decleration_or_null(import.identifier)) {
+			raise_error()
+				->message("'")->message(import.identifier.to_str())->message("' is not declared in module '")->message(import.module->path())->message("': ")
+				->highlight_token(import.identifier);
+		}
+	}
+	link_externals();
+}
+
+void ModuleCompiler::link_externals() {
+	for (auto link : m_external_links) {
+		ast::Decl* decl = nullptr;
+		for (auto& import : m_imports) {
+			ModuleCompiler* imported = m_compiler->module_compiler_or_null(import.module);
+			if (!import.identifier)
+				decl = imported->scope()->get_decleration_or_null(link->m_identifier);
+			else if ((import.as ? import.as : import.identifier).equals(link->m_identifier))
+				decl = imported->scope()->get_decleration_or_null(import.identifier);
+			if (decl)
+				break;
+		}
+		if (decl && link->resolve(m_module, decl))
+			continue;
+
+		// Types that stay unresolved are reported by the type inferer where they are used.
+		if (link->m_target_decl) {
+			raise_error()
+				->message("'")->message(link->m_identifier.to_str())->message("' is not declared: ")
+				->highlight_token(link->m_identifier);
+		}
+	}
+	m_external_links.clear();
+}
 
+void ModuleCompiler::add_dependency(Module* module) {
+	if (module && std::find(m_dependencies.begin(), m_dependencies.end(), module) == m_dependencies.end())
+		m_dependencies.push_back(module);
 }
 
 CompilerError* ModuleCompiler::raise_error() {
@@ -455,6 +1233,7 @@ void ModuleCompiler::print_errors(std::ostream& stream) {
 Compiler::Compiler(Project* project, Runtime* runtime)
 	: m_project(project), m_runtime(runtime), m_global_scope(nullptr) {
 	m_encountered_errors = false;
+	declare_intrinsics();
 }
 
 Compiler::~Compiler() {
@@ -467,47 +1246,191 @@ void Compiler::compile() {
 	for (auto it = m_project->modules_begin(); it != m_project->modules_end(); ++it) {
 		ModuleCompiler* module_compiler = ModuleCompiler::Create(this, it->second);
 		m_module_compilers.push_back(module_compiler);
+		m_module_to_module_compilers[it->second] = module_compiler;
 	}
 
-	while (m_module_compilers_index < m_module_compilers.size()) {
-		ModuleCompiler* module_compiler = m_module_compilers[m_module_compilers_index++];
+	// Read every known module in one batch, modules found later through imports are read on their own.
+	SourceLoader source_loader;
+	for (auto module_compiler : m_module_compilers)
+		source_loader.add(module_compiler->source());
+	source_loader.load();
+
+	// Modules whose cache entry is still up to date are left alone entirely, they end up without an AST or
+	// bytecode. Whatever is printed comes from the modules themselves, so the cache is skipped whenever
+	// tokens, the AST or the opcodes are printed. A watching compiler keeps every module in memory instead
+	// and needs all of them compiled once.
+	const Settings& settings = m_project->settings();
+	ModuleCache* cache = nullptr;
+	if (settings.use_cache && !settings.watch && !settings.print_tokens && !settings.print_ast && !settings.print_opcodes)
+		cache = new ModuleCache(settings.cache_folder, settings);
+
+	std::vector<ModuleCompiler*> stale_module_compilers;
+	for (auto module_compiler : m_module_compilers) {
+		if (cache && module_compiler->source()->is_loaded())
+			cache->add(module_compiler->source());
+	}
+	for (auto module_compiler : m_module_compilers) {
+		if (!cache || !cache->is_up_to_date(module_compiler->module()->path()))
+			stale_module_compilers.push_back(module_compiler);
+	}
 
-		if (m_project->settings().print_tokens) {
-			Tokenizer tokenizer(module_compiler);
-			Token token;
+	compile_modules(stale_module_compilers, cache);
+	delete cache;
+}
 
-			std::cout << "Tokens for module '" << module_compiler->source()->path() << "':" << std::endl;
-			do {
-				token = tokenizer.eat();
-				std::string type_str = Token::TokenTypeToString(token.type());
-				std::cout << "    " << type_str;
-				for (auto i = type_str.size(); i < 17; i++)
-					std::cout << ' ';
-				std::cout << token.to_str() << std::endl;
-			} while (!token.is(TokenType::EOFToken));
+void Compiler::recompile(const std::vector<Module*>& changed_modules) {
+	std::vector<ModuleCompiler*> stale_module_compilers;
+	auto mark_stale = [&](ModuleCompiler* module_compiler) {
+		if (std::find(stale_module_compilers.begin(), stale_module_compilers.end(), module_compiler) == stale_module_compilers.end())
+			stale_module_compilers.push_back(module_compiler);
+	};
 
+	for (auto module : changed_modules) {
+		auto it = m_module_to_module_compilers.find(module);
+		if (it != m_module_to_module_compilers.end())
+			mark_stale(it->second);
+	}
+	// An error anywhere stopped inference everywhere, modules that were never analyzed have to go again.
+	for (auto module_compiler : m_module_compilers) {
+		if (!module_compiler->is_analyzed())
+			mark_stale(module_compiler);
+	}
+	// Everything importing a stale module saw its old declarations.
+	for (i32 i = 0; i < (i32)stale_module_compilers.size(); i++) {
+		for (auto module_compiler : m_module_compilers) {
+			auto& dependencies = module_compiler->dependencies();
+			if (std::find(dependencies.begin(), dependencies.end(), stale_module_compilers[i]->module()) != dependencies.end())
+				mark_stale(module_compiler);
 		}
-
-		module_compiler->parse_and_link_internals();
 	}
+	if (stale_module_compilers.empty())
+		return;
 
-	// Link remaining
-	if (!encountered_error()) {
-		m_module_compilers_index = 0;
-		while (m_module_compilers_index < m_module_compilers.size()) {
-			ModuleCompiler* module_compiler = m_module_compilers[m_module_compilers_index++];
-			module_compiler->infer_types_and_do_semantic_analysis();
+	// Modules in module order, so printing and errors come out the same way a full compile has them.
+	std::vector<ModuleCompiler*> ordered_module_compilers;
+	for (auto module_compiler : m_module_compilers) {
+		if (std::find(stale_module_compilers.begin(), stale_module_compilers.end(), module_compiler) != stale_module_compilers.end()) {
+			module_compiler->reset();
+			ordered_module_compilers.push_back(module_compiler);
 		}
 	}
 
+	SourceLoader source_loader;
+	for (auto module_compiler : ordered_module_compilers)
+		source_loader.add(module_compiler->source());
+	source_loader.load();
+
+	m_encountered_errors = false;
 	for (auto module_compiler : m_module_compilers) {
-		ASTPrinter printer(std::cout);
-		printer.visit(module_compiler);
+		if (module_compiler->encountered_error())
+			mark_encoutered_error();
 	}
+	compile_modules(ordered_module_compilers, nullptr);
 }
 
-void Compiler::add_link(Link* link) {
+void Compiler::compile_modules(const std::vector<ModuleCompiler*>& module_compilers, ModuleCache* cache) {
+	const Settings& settings = m_project->settings();
+
+	// Every module has its own allocator, source and error list, so modules are parsed and inferred in
+	// parallel. Anything that crosses modules is merged afterwards in module order to keep the output stable.
+	ThreadPool* pool = nullptr;
+	auto for_each_module = [&](const std::vector<ModuleCompiler*>& modules, const std::function<void(ModuleCompiler*)>& step) {
+		if (modules.size() < 2) {
+			for (auto module_compiler : modules)
+				step(module_compiler);
+			return;
+		}
+		if (!pool)
+			pool = new ThreadPool();
+		pool->parallel_for(0, (i64)modules.size(), [&](i64 begin, i64 end, i32) {
+			for (i64 i = begin; i < end; i++)
+				step(modules[i]);
+		});
+	};
+
+	// Parsing finds the imports, so modules are parsed in waves until no wave imports anything new.
+	std::vector<ModuleCompiler*> compiled_module_compilers;
+	std::vector<ModuleCompiler*> wave = module_compilers;
+	while (!wave.empty()) {
+		SourceLoader source_loader;
+		for (auto module_compiler : wave)
+			source_loader.add(module_compiler->source());
+		source_loader.load();
+
+		for (auto module_compiler : wave) {
+			if (!module_compiler->source()->is_loaded())
+				module_compiler->source()->load();
+
+			if (settings.print_tokens) {
+				// Parsing reads the same tokens afterwards instead of tokenizing the module again.
+				Tokenizer* tokenizer = module_compiler->create_tokenizer(true);
+				Token token;
+
+				std::cout << "Tokens for module '" << module_compiler->source()->path() << "':" << std::endl;
+				do {
+					token = tokenizer->eat();
+					std::string type_str = Token::TokenTypeToString(token.type());
+					std::cout << "    " << type_str;
+					for (auto i = type_str.size(); i < 17; i++)
+						std::cout << ' ';
+					std::cout << token.to_str() << std::endl;
+				} while (!token.is(TokenType::EOFToken));
+				tokenizer->seek(0);
+			}
+		}
+
+		for_each_module(wave, [](ModuleCompiler* module_compiler) {
+			module_compiler->parse_and_link_internals();
+		});
+		compiled_module_compilers.insert(compiled_module_compilers.end(), wave.begin(), wave.end());
+		wave = unparsed_imports(wave);
+	}
+
+	for_each_module(compiled_module_compilers, [](ModuleCompiler* module_compiler) {
+		module_compiler->link_imports();
+	});
+
+	ModuleGraph graph(m_module_compilers);
+	std::vector<ModuleCompiler*> cycle = graph.find_cycle();
+	if (!cycle.empty()) {
+		CompilerError* error = cycle[0]->raise_error()->message("Modules can't import each other in a cycle: ");
+		for (i32 i = 0; i < (i32)cycle.size(); i++)
+			error->message(i == 0 ? "'" : " -> '")->message(cycle[i]->module()->path())->message("'");
+	}
+
+	// Link remaining
+	if (!encountered_error()) {
+		// A module reads the inferred declarations of its imports, so it waits for their wave to finish.
+		for (auto& wave : graph.waves(compiled_module_compilers)) {
+			for_each_module(wave, [](ModuleCompiler* module_compiler) {
+				module_compiler->infer_types_and_do_semantic_analysis();
+			});
+		}
+	}
+	delete pool;
+
+	// An error anywhere stops inference everywhere, so only a fully successful compile is remembered.
+	if (cache && !encountered_error()) {
+		for (auto module_compiler : compiled_module_compilers) {
+			std::vector<ModuleCache::Dependency> dependencies;
+			for (auto module : module_compiler->dependencies())
+				dependencies.push_back({ module->path(), cache->key_of(module->path()) });
+			cache->store(module_compiler->module()->path(), dependencies);
+		}
+	}
 
+	if (settings.print_ast) {
+		for (auto module_compiler : compiled_module_compilers) {
+			ASTPrinter printer(std::cout);
+			printer.visit(module_compiler);
+		}
+	}
+	// Bodies are only compiled once inference went through everywhere.
+	if (settings.print_opcodes && !encountered_error()) {
+		OpCodePrinter printer(std::cout);
+		for (auto module_compiler : compiled_module_compilers)
+			printer.print(module_compiler);
+	}
 }
 
 CompilerError* Compiler::raise_error() {
@@ -524,13 +1447,216 @@ void Compiler::print_errors(std::ostream& stream) {
 	}
 }
 
-Module* Compiler::resolve_module(const std::string& path) {
+static std::string join_path(const std::string& folder, const std::string& path) {
+	if (folder.empty() || folder == ".")
+		return path;
+	if (folder.back() == '/')
+		return folder + path;
+	return folder + "/" + path;
+}
+
+Module* Compiler::resolve_module(const std::string& path, Module* relative_to) {
+	std::vector<std::string> candidates;
+	if (relative_to) {
+		auto slash = relative_to->path().find_last_of('/');
+		std::string folder = slash == std::string::npos ? "" : relative_to->path().substr(0, slash);
+		candidates.push_back(join_path(folder, path + ".ipa"));
+	} else {
+		for (auto& folder : m_project->settings().source_folders)
+			candidates.push_back(join_path(folder, path + ".ipa"));
+	}
+
+	for (auto& candidate : candidates) {
+		{
+			std::lock_guard<std::mutex> lock(m_modules_mutex);
+			if (Module* module = m_project->get_module(candidate))
+				return module;
+		}
+		// Only existing files become modules, a file nobody imports is never even opened.
+		if (!std::ifstream(candidate))
+			continue;
+		std::lock_guard<std::mutex> lock(m_modules_mutex);
+		return m_project->get_or_create_module(candidate);
+	}
 	return nullptr;
 }
 
+ModuleCompiler* Compiler::module_compiler_or_null(Module* module) const {
+	auto it = m_module_to_module_compilers.find(module);
+	return it == m_module_to_module_compilers.end() ? nullptr : it->second;
+}
+
+std::vector<ModuleCompiler*> Compiler::unparsed_imports(const std::vector<ModuleCompiler*>& module_compilers) {
+	std::vector<ModuleCompiler*> result;
+	for (auto importer : module_compilers) {
+		for (auto module : importer->dependencies()) {
+			ModuleCompiler* module_compiler = module_compiler_or_null(module);
+			if (!module_compiler) {
+				module_compiler = ModuleCompiler::Create(this, module);
+				m_module_compilers.push_back(module_compiler);
+				m_module_to_module_compilers[module] = module_compiler;
+			}
+			// Modules the cache let us skip are parsed after all once a recompiled module imports them.
+			if (!module_compiler->is_parsed() && std::find(result.begin(), result.end(), module_compiler) == result.end())
+				result.push_back(module_compiler);
+		}
+	}
+	return result;
+}
+
+void Compiler::declare_intrinsics() {
+	static const struct {
+		const char* name;
+		Intrinsic intrinsic;
+	} s_intrinsics[] = {
+		{ "shuffle",    Intrinsic::ShuffleIntrinsic   },
+		{ "reduce_add", Intrinsic::ReduceAddIntrinsic },
+		{ "reduce_min", Intrinsic::ReduceMinIntrinsic },
+		{ "reduce_max", Intrinsic::ReduceMaxIntrinsic },
+		{ "sum",        Intrinsic::SumIntrinsic       },
+		{ "min",        Intrinsic::MinIntrinsic       },
+		{ "max",        Intrinsic::MaxIntrinsic       },
+		{ "dot",        Intrinsic::DotIntrinsic       },
+		{ "axpy",       Intrinsic::AxpyIntrinsic      },
+		{ "scale",      Intrinsic::ScaleIntrinsic     },
+		{ "send",       Intrinsic::SendIntrinsic      },
+		{ "recv",       Intrinsic::RecvIntrinsic      },
+		{ "atomic_load",  Intrinsic::AtomicLoadIntrinsic  },
+		{ "atomic_store", Intrinsic::AtomicStoreIntrinsic },
+		{ "atomic_add",   Intrinsic::AtomicAddIntrinsic   },
+		{ "atomic_cas",   Intrinsic::AtomicCasIntrinsic   },
+		{ "parallel_sum",    Intrinsic::ParallelSumIntrinsic    },
+		{ "parallel_reduce", Intrinsic::ParallelReduceIntrinsic },
+		{ "io_read",  Intrinsic::IoReadIntrinsic  },
+		{ "io_write", Intrinsic::IoWriteIntrinsic },
+		{ "io_close", Intrinsic::IoCloseIntrinsic },
+	};
+
+	std::vector<ast::Decl*> declerations;
+	for (const auto& entry : s_intrinsics) {
+		i32 length = (i32)strlen(entry.name);
+		Token name(TokenType::IdentifierToken, entry.name, length, -1, m_project->symbols().intern(entry.name, length));
+		ast::Function* function = ast::Function::Create(&m_allocator, name, nullptr, 0, nullptr);
+		function->intrinsic = entry.intrinsic;
+		declerations.push_back(function);
+	}
+
+	m_global_scope = ast::Scope::Create(&m_allocator, nullptr);
+	m_global_scope->fill_out_declerations(&m_allocator, &declerations[0], (i32)declerations.size());
+}
+
+
+void EscapeAnalyzer::analyze(ast::Function* function) {
+	accept(function->body);
+}
+
+void EscapeAnalyzer::visit(ast::Block* block) {
+	m_locals.insert(m_locals.end(), block->local_variables, block->local_variables + block->local_variables_count);
+	for (i32 i = 0; i < block->statements_count; i++)
+		accept(block->statements[i]);
+}
+
+void EscapeAnalyzer::visit(ast::IfStmt* stmt) {
+	accept(stmt->condition);
+	accept(stmt->true_block);
+	accept(stmt->false_block);
+}
+
+void EscapeAnalyzer::visit(ast::ForStmt* stmt) {
+	accept(stmt->array_expr);
+	accept(stmt->low_expr);
+	accept(stmt->high_expr);
+	accept(stmt->block);
+}
+
+void EscapeAnalyzer::visit(ast::WhileStmt* stmt) {
+	accept(stmt->condition);
+	accept(stmt->loop_body);
+}
+
+void EscapeAnalyzer::visit(ast::ReturnStmt* stmt) {
+	accept(stmt->return_value);
+}
+
+void EscapeAnalyzer::visit(ast::ExprStmt* stmt) {
+	accept(stmt->expr);
+}
+
+void EscapeAnalyzer::visit(ast::LoadExpr* expr) {
+	if (expr->structure_expr) {
+		// Member accesses go through the reference without handing it out.
+		ast::LoadExpr* structure = expr->structure_expr->as_or_null<ast::LoadExpr>();
+		if (!structure || structure->structure_expr || structure->constant)
+			accept(expr->structure_expr);
+		return;
+	}
+
+	ast::Variable* variable = expr->loaded_decl ? expr->loaded_decl->as_or_null<ast::Variable>() : nullptr;
+	if (variable && (variable->decl_flags & ast::Decl::LOCAL) && variable->type && variable->type->is_struct())
+		variable->decl_flags |= ast::Decl::ESCAPES;
+}
+
+void EscapeAnalyzer::visit(ast::OperandExpr* expr) {
+	accept(expr->lhs);
+	accept(expr->rhs);
+}
+
+void EscapeAnalyzer::visit(ast::CallExpr* expr) {
+	accept(expr->callable);
+	for (i32 i = 0; i < expr->arguments_count; i++)
+		accept(expr->arguments[i]);
+}
+
+void EscapeAnalyzer::visit(ast::ArrayAccessExpr* expr) {
+	accept(expr->array_expr);
+	accept(expr->index_expr);
+}
+
+void EscapeAnalyzer::visit(ast::CastExpr* expr) {
+	accept(expr->expr);
+}
+
+
+const FunctionCode* FunctionCompiler::CodeFor(ast::Function* function) {
+	const FunctionCode* code = function->code.load(std::memory_order_acquire);
+	if (code || !function->owner)
+		return code;
+	return function->owner->compile_function(function);
+}
 
 void FunctionCompiler::compile() {
-	
+	EscapeAnalyzer escape_analyzer;
+	escape_analyzer.analyze(m_function);
+
+	for (i32 i = 0; i < m_function->arguments_count; i++)
+		allocate_local_slot(m_function->arguments[i]);
+
+	// Structs that never leave the call live in the frame arena and are released on return, channels are
+	// freed on the way out of the frame. Both are created once here, creating them where their block starts
+	// would allocate again on every iteration of a loop around the block.
+	for (ast::Variable* variable : escape_analyzer.locals()) {
+		if (!variable->type || variable->default_value)
+			continue;
+		if (variable->type->is_struct() && (variable->decl_flags & ast::Decl::ESCAPES) != ast::Decl::ESCAPES) {
+			emit(OpCode::OpFrameAlloc);
+			emit_u8(allocate_local_slot(variable));
+			emit_u32(variable->type->size);
+		} else if (variable->type->is_channel()) {
+			bool is_spsc = (variable->decl_flags & ast::Decl::SPSC) == ast::Decl::SPSC;
+			u8 slot = allocate_local_slot(variable);
+			emit(OpCode::OpChannelNew);
+			emit_u8(slot);
+			emit_u8(is_spsc ? 1 : 0);
+			emit_u32(static_cast<ast::ChannelType*>(variable->type)->capacity);
+			m_frame_channel_slots.push_back(slot);
+		}
+	}
+	accept(m_function->body);
+
+	// Running off the end of the body leaves the frame as well.
+	ast::Block* body = m_function->body;
+	if (!body || body->statements_count == 0 || !body->statements[body->statements_count - 1]->as_or_null<ast::ReturnStmt>())
+		emit_frame_exit();
 }
 
 void FunctionCompiler::visit(ast::Function* function) {
@@ -538,6 +1664,18 @@ void FunctionCompiler::visit(ast::Function* function) {
 }
 
 void FunctionCompiler::visit(ast::Block* block) {
+	for (i32 i = 0; i < block->local_variables_count; i++) {
+		ast::Variable* variable = block->local_variables[i];
+		// Created in the prologue.
+		if (get_local_slot_or_minus_one(variable) >= 0)
+			continue;
+		u8 slot = allocate_local_slot(variable);
+		if (variable->type && variable->type->is_struct() && !variable->default_value) {
+			emit(OpCode::OpHeapAlloc);
+			emit_u8(slot);
+			emit_u32(variable->type->size);
+		}
+	}
 	for (i32 i = 0; i < block->statements_count; i++)
 		accept(block->statements[i]);
 }
@@ -546,8 +1684,43 @@ void FunctionCompiler::visit(ast::IfStmt* expr) {
 
 }
 
-void FunctionCompiler::visit(ast::ForStmt* expr) {
+void FunctionCompiler::visit(ast::ForStmt* stmt) {
+	if (stmt->array_expr)
+		return;
+
+	// Index and end bound live in two adjacent slots, so a single opcode can step, compare and branch.
+	ast::Type* range_type = get_range_type_or_null(stmt);
+	bool is_64_bit = range_type->size == 8;
+	accept(stmt->low_expr);
+	if (is_64_bit && stmt->low_expr->type->size != 8)
+		emit(OpCode::OpS32toS64);
+	accept(stmt->high_expr);
+	if (is_64_bit && stmt->high_expr->type->size != 8)
+		emit(OpCode::OpS32toS64);
+
+	u8 slot = allocate_local_slot(stmt->it_var);
+	allocate_local_slot(nullptr);
+
+	if (stmt->is_parallel) {
+		emit(is_64_bit ? OpCode::OpParallelForI64 : OpCode::OpParallelForI32);
+		emit_u8(slot);
+		i32 body_jump = emit_jump_offset();
+		accept(stmt->block);
+		patch_jump_offset(body_jump, (i32)m_code.size());
+		return;
+	}
+
+	emit(is_64_bit ? OpCode::OpForRangePrepI64 : OpCode::OpForRangePrepI32);
+	emit_u8(slot);
+	i32 exit_jump = emit_jump_offset();
+
+	i32 loop_start = (i32)m_code.size();
+	accept(stmt->block);
 
+	emit(is_64_bit ? OpCode::OpForRangeI64 : OpCode::OpForRangeI32);
+	emit_u8(slot);
+	patch_jump_offset(emit_jump_offset(), loop_start);
+	patch_jump_offset(exit_jump, (i32)m_code.size());
 }
 
 void FunctionCompiler::visit(ast::WhileStmt* expr) {
@@ -555,17 +1728,39 @@ void FunctionCompiler::visit(ast::WhileStmt* expr) {
 }
 
 void FunctionCompiler::visit(ast::ReturnStmt* expr) {
-	if (!expr->return_value)
-		m_opcodes.push_back(OpCode::OpReturnVoid);
-	else {
+	ast::CallExpr* call = expr->return_value ? expr->return_value->as_or_null<ast::CallExpr>() : nullptr;
+	if (!expr->return_value) {
+		emit_frame_exit();
+		emit(OpCode::OpReturnVoid);
+	} else if (call && is_tail_call(call)) {
+		// The callee returns straight to our caller, so its frame can replace ours.
+		for (i32 i = 0; i < call->arguments_count; i++) {
+			accept(call->arguments[i]);
+		}
+		emit_frame_exit();
+		emit(OpCode::OpTailCall);
+		emit_u64((u64)get_callee_or_null(call));
+	} else {
 		accept(expr->return_value);
-		m_opcodes.push_back(OpCode::OpReturn);
+		emit_frame_exit();
+		emit(OpCode::OpReturn);
 	}
 }
 
 void FunctionCompiler::visit(ast::ExprStmt* expr) {
 	accept(expr->expr);
-	m_opcodes.push_back(OpCode::OpPop32);
+	// Void calls such as axpy and stores leave nothing behind to pop.
+	ast::OperandExpr* operand_expr = expr->expr->as_or_null<ast::OperandExpr>();
+	if (operand_expr && operand_expr->operand == Operand::SetOperand)
+		return;
+	if (!expr->expr->type) {
+		emit(OpCode::OpPop);
+		return;
+	}
+	if (expr->expr->type->primitive() == Primitive::VoidPrimitive)
+		return;
+	for (i32 i = 0; i < get_slot_count(expr->expr->type); i++)
+		emit(OpCode::OpPop);
 }
 
 void FunctionCompiler::visit(ast::LoadExpr* expr) {
@@ -573,23 +1768,307 @@ void FunctionCompiler::visit(ast::LoadExpr* expr) {
 
 	}
 	else if (expr->structure_expr) {
+		ast::ArrayAccessExpr* element = expr->structure_expr->as_or_null<ast::ArrayAccessExpr>();
+		ast::Type* element_type = element ? element->type : nullptr;
+		if (element_type && element_type->is_struct() && static_cast<ast::StructType*>(element_type)->is_soa()) {
+			// Every member of a soa struct is stored in its own column, so index straight into the column.
+			ast::Struct* structure = static_cast<ast::StructType*>(element_type)->structure;
+			i32 member_index = structure->get_member_index_or_minus_one(expr->loaded_decl->as_or_assert<ast::Variable>());
+			assert(member_index >= 0 && member_index < 256);
+			accept(element->array_expr);
+			emit(OpCode::OpArrayColumn);
+			emit_u8((u8)member_index);
+			accept(element->index_expr);
+			emit(get_array_load_opcode(expr->type));
+		}
+	}
+	else if (ast::Variable* variable = expr->loaded_decl ? expr->loaded_decl->as_or_null<ast::Variable>() : nullptr) {
+		i32 slot = get_local_slot_or_minus_one(variable);
+		if (slot >= 0) {
+			emit(get_local_load_opcode(variable->type));
+			emit_u8((u8)slot);
+		}
+	}
+}
+
+void FunctionCompiler::visit(ast::OperandExpr* expr) {
+	if (!expr->type || !expr->type->is_vector())
+		return;
+	if (expr->operand == Operand::SetOperand) {
+		// Vectors are only stored to locals, members and elements are never vectors.
+		ast::LoadExpr* target = expr->lhs->as_or_null<ast::LoadExpr>();
+		ast::Variable* variable = target && !target->structure_expr && target->loaded_decl ? target->loaded_decl->as_or_null<ast::Variable>() : nullptr;
+		i32 slot = variable ? get_local_slot_or_minus_one(variable) : -1;
+		if (slot >= 0) {
+			accept(expr->rhs);
+			emit(get_slot_count(expr->type) == 2 ? OpCode::OpStoreLocalV128 : OpCode::OpStoreLocalV256);
+			emit_u8((u8)slot);
+		}
+		return;
+	}
+	accept(expr->lhs);
+	accept(expr->rhs);
+	emit(get_vector_opcode(expr->operand, expr->type));
+}
 
+void FunctionCompiler::visit(ast::CallExpr* expr) {
+	ast::Function* callee = get_callee_or_null(expr);
+	if (callee && callee->intrinsic != Intrinsic::NoIntrinsic) {
+		compile_intrinsic_call(expr, callee->intrinsic);
+		return;
 	}
-	else {
 
+	// Direct calls name their callee in the operand, it is compiled when the call first runs.
+	if (!callee)
+		accept(expr->callable);
+	for (i32 i = 0; i < expr->arguments_count; i++) {
+		accept(expr->arguments[i]);
 	}
+	emit(OpCode::OpCall);
+	emit_u64((u64)callee);
 }
 
-void FunctionCompiler::visit(ast::OperandExpr* expr) {
+bool FunctionCompiler::is_tail_call(ast::CallExpr* expr) {
+	ast::Function* callee = get_callee_or_null(expr);
+	if (!callee || callee->intrinsic != Intrinsic::NoIntrinsic)
+		return false;
+	// Our caller expects our return value, so the callee has to produce the exact same type.
+	return callee->return_type == m_function->return_type;
+}
 
+void FunctionCompiler::compile_intrinsic_call(ast::CallExpr* expr, Intrinsic intrinsic) {
+	if (intrinsic >= Intrinsic::IoReadIntrinsic) {
+		for (i32 i = 0; i < expr->arguments_count; i++)
+			accept(expr->arguments[i]);
+		// Same order as the intrinsics.
+		emit((OpCode)((i32)OpCode::OpIoRead + (i32)intrinsic - (i32)Intrinsic::IoReadIntrinsic));
+		return;
+	}
+	if (intrinsic >= Intrinsic::ParallelSumIntrinsic) {
+		compile_parallel_intrinsic_call(expr, intrinsic);
+		return;
+	}
+	if (intrinsic >= Intrinsic::AtomicLoadIntrinsic) {
+		compile_atomic_intrinsic_call(expr, intrinsic);
+		return;
+	}
+	if (intrinsic >= Intrinsic::SendIntrinsic) {
+		for (i32 i = 0; i < expr->arguments_count; i++)
+			accept(expr->arguments[i]);
+		emit(intrinsic == Intrinsic::SendIntrinsic ? OpCode::OpChannelSend : OpCode::OpChannelRecv);
+		return;
+	}
+	if (intrinsic >= Intrinsic::SumIntrinsic) {
+		compile_array_intrinsic_call(expr, intrinsic);
+		return;
+	}
+
+	ast::Type* vector_type = expr->arguments[0]->type;
+	// Reductions come in add, min, max triplets, one per vector primitive.
+	i32 vector_index = (i32)vector_type->primitive() - (i32)Primitive::F32x4Primitive;
+
+	accept(expr->arguments[0]);
+	switch (intrinsic) {
+	case(Intrinsic::ShuffleIntrinsic): {
+		u8 control = 0;
+		for (i32 i = 1; i < expr->arguments_count; i++) {
+			u8 lane = (u8)(expr->arguments[i]->as_or_assert<ast::LoadExpr>()->constant.first_char_ptr()[0] - '0');
+			control |= lane << ((i - 1) * 2);
+		}
+		emit(OpCode::OpShuffle32x4);
+		emit_u8(control);
+	} break;
+	case(Intrinsic::ReduceAddIntrinsic):
+		emit((OpCode)((i32)OpCode::OpReduceAddF32x4 + vector_index * 3 + 0));
+		break;
+	case(Intrinsic::ReduceMinIntrinsic):
+		emit((OpCode)((i32)OpCode::OpReduceAddF32x4 + vector_index * 3 + 1));
+		break;
+	case(Intrinsic::ReduceMaxIntrinsic):
+		emit((OpCode)((i32)OpCode::OpReduceAddF32x4 + vector_index * 3 + 2));
+		break;
+	default:
+		assert(false);
+		break;
+	}
 }
 
-void FunctionCompiler::visit(ast::CallExpr* expr) {
-	accept(expr->callable);
+void FunctionCompiler::compile_array_intrinsic_call(ast::CallExpr* expr, Intrinsic intrinsic) {
+	// The whole loop runs inside the kernel, we only push the operands in declaration order.
+	ast::Type* element_type = nullptr;
 	for (i32 i = 0; i < expr->arguments_count; i++) {
 		accept(expr->arguments[i]);
+		if (expr->arguments[i]->type->is_array())
+			element_type = static_cast<ast::ArrayType*>(expr->arguments[i]->type)->element_type;
+	}
+
+	// Every kernel has one opcode per element type, in the same order as the intrinsics.
+	i32 operation = (i32)intrinsic - (i32)Intrinsic::SumIntrinsic;
+	emit((OpCode)((i32)OpCode::OpArraySumS32 + operation * 4 + get_kernel_element_index_or_minus_one(element_type)));
+}
+
+void FunctionCompiler::compile_atomic_intrinsic_call(ast::CallExpr* expr, Intrinsic intrinsic) {
+	// The address goes first, the operands are pushed on top of it.
+	ast::LoadExpr* target = expr->arguments[0]->as_or_assert<ast::LoadExpr>();
+	ast::Variable* variable = target->loaded_decl->as_or_assert<ast::Variable>();
+	if (target->structure_expr) {
+		ast::StructType* struct_type = static_cast<ast::StructType*>(target->structure_expr->type);
+		i32 member_index = struct_type->structure->get_member_index_or_minus_one(variable);
+		assert(member_index >= 0 && member_index < 256);
+		accept(target->structure_expr);
+		emit(OpCode::OpMemberRef);
+		emit_u8((u8)member_index);
+	} else {
+		emit(OpCode::OpGlobalRef);
+		emit_u64((u64)variable);
+	}
+
+	for (i32 i = 1; i < expr->arguments_count; i++)
+		accept(expr->arguments[i]);
+
+	// Signedness does not matter for any of them, only the width picks the opcode.
+	i32 operation = (i32)intrinsic - (i32)Intrinsic::AtomicLoadIntrinsic;
+	bool is_64_bit = target->type->size == 8;
+	emit((OpCode)((i32)OpCode::OpAtomicLoadI32 + operation * 2 + (is_64_bit ? 1 : 0)));
+}
+
+void FunctionCompiler::compile_parallel_intrinsic_call(ast::CallExpr* expr, Intrinsic intrinsic) {
+	bool is_reduce = intrinsic == Intrinsic::ParallelReduceIntrinsic;
+	i32 elements_index = is_reduce ? 2 : 1;
+	bool is_range = expr->arguments_count == elements_index + 2;
+	ast::Function* function = expr->arguments[0]->as_or_assert<ast::LoadExpr>()->loaded_decl->as_or_assert<ast::Function>();
+	ast::Type* element_type = function->arguments[0]->type;
+
+	if (is_reduce)
+		accept(expr->arguments[1]);
+	if (is_range) {
+		// Both bounds take the width of the function's argument, like the counters of range loops.
+		for (i32 i = elements_index; i < elements_index + 2; i++) {
+			accept(expr->arguments[i]);
+			if (element_type->size == 8 && expr->arguments[i]->type->size != 8)
+				emit(OpCode::OpS32toS64);
+		}
+	} else {
+		accept(expr->arguments[elements_index]);
+	}
+
+	if (is_reduce) {
+		emit(is_range ? OpCode::OpParallelReduceRange : OpCode::OpParallelReduceArray);
+		emit_u64((u64)function);
+	} else {
+		emit(is_range ? OpCode::OpParallelSumRange : OpCode::OpParallelSumArray);
+		emit_u64((u64)function);
+		emit_u8((u8)get_kernel_element_index_or_minus_one(function->return_type));
+	}
+}
+
+OpCode FunctionCompiler::get_vector_opcode(Operand operand, ast::Type* type) {
+	i32 operation;
+	switch (operand) {
+	case(Operand::AddOperand):    operation = 0; break;
+	case(Operand::SubOperand):    operation = 1; break;
+	case(Operand::MulOperand):    operation = 2; break;
+	case(Operand::DivOperand):    operation = 3; break;
+	case(Operand::LtOperand):     operation = 4; break;
+	case(Operand::GtOperand):     operation = 5; break;
+	case(Operand::EqualsOperand): operation = 6; break;
+	default:
+		assert(false && "Operand not supported on vectors. ");
+		return OpCode::OpNop;
+	}
+	// Every lane type has the same seven opcodes, in the same order as the vector primitives.
+	i32 vector_index = (i32)type->primitive() - (i32)Primitive::F32x4Primitive;
+	return (OpCode)((i32)OpCode::OpAddF32x4 + vector_index * 7 + operation);
+}
+
+i32 FunctionCompiler::emit_jump_offset() {
+	i32 offset_position = (i32)m_code.size();
+	emit_u8(0);
+	emit_u8(0);
+	return offset_position;
+}
+
+void FunctionCompiler::patch_jump_offset(i32 offset_position, i32 target) {
+	// Jumps are relative to the end of the offset, which is also the end of the instruction.
+	i32 offset = target - (offset_position + 2);
+	assert((i16)offset == offset);
+	m_code[offset_position]     = (u8)(offset & 0xFF);
+	m_code[offset_position + 1] = (u8)((offset >> 8) & 0xFF);
+}
+
+void FunctionCompiler::emit_frame_exit() {
+	for (u8 slot : m_frame_channel_slots) {
+		emit(OpCode::OpChannelFree);
+		emit_u8(slot);
+	}
+}
+
+u8 FunctionCompiler::allocate_local_slot(ast::Variable* variable) {
+	i32 slot = (i32)m_local_slots.size();
+	i32 slot_count = variable && variable->type ? get_slot_count(variable->type) : 1;
+	assert(slot + slot_count <= 256);
+	// Only the first slot names the variable, the rest are hidden like the end of a range loop.
+	m_local_slots.push_back(variable);
+	m_local_slots.resize(slot + slot_count, nullptr);
+	return (u8)slot;
+}
+
+i32 FunctionCompiler::get_local_slot_or_minus_one(ast::Variable* variable) {
+	for (i32 i = (i32)m_local_slots.size() - 1; i >= 0; i--) {
+		if (m_local_slots[i] == variable)
+			return i;
+	}
+	return -1;
+}
+
+i32 FunctionCompiler::get_slot_count(ast::Type* type) {
+	if (!type->is_vector())
+		return 1;
+	return simd::get_slot_count(get_vector_opcode(Operand::AddOperand, type));
+}
+
+OpCode FunctionCompiler::get_local_load_opcode(ast::Type* type) {
+	if (type->is_struct() || type->is_array() || type->is_channel())
+		return OpCode::OpLoadLocalRef;
+	if (type->is_vector())
+		return get_slot_count(type) == 2 ? OpCode::OpLoadLocalV128 : OpCode::OpLoadLocalV256;
+	switch (type->primitive()) {
+	case(Primitive::BoolPrimitive):
+	case(Primitive::U8Primitive):  return OpCode::OpLoadLocalU8;
+	case(Primitive::S8Primitive):  return OpCode::OpLoadLocalS8;
+	case(Primitive::U16Primitive): return OpCode::OpLoadLocalU16;
+	case(Primitive::S16Primitive): return OpCode::OpLoadLocalS16;
+	case(Primitive::U32Primitive):
+	case(Primitive::S32Primitive): return OpCode::OpLoadLocalI32;
+	case(Primitive::U64Primitive):
+	case(Primitive::S64Primitive): return OpCode::OpLoadLocalI64;
+	case(Primitive::F32Primitive): return OpCode::OpLoadLocalF32;
+	case(Primitive::F64Primitive): return OpCode::OpLoadLocalF64;
+	default:
+		assert(false);
+		break;
+	}
+	return OpCode::OpNop;
+}
+
+OpCode FunctionCompiler::get_array_load_opcode(ast::Type* element_type) {
+	switch (element_type->primitive()) {
+	case(Primitive::BoolPrimitive):
+	case(Primitive::U8Primitive):  return OpCode::OpArrayLoadU8;
+	case(Primitive::S8Primitive):  return OpCode::OpArrayLoadS8;
+	case(Primitive::U16Primitive): return OpCode::OpArrayLoadU16;
+	case(Primitive::S16Primitive): return OpCode::OpArrayLoadS16;
+	case(Primitive::U32Primitive):
+	case(Primitive::S32Primitive): return OpCode::OpArrayLoadI32;
+	case(Primitive::U64Primitive):
+	case(Primitive::S64Primitive): return OpCode::OpArrayLoadI64;
+	case(Primitive::F32Primitive): return OpCode::OpArrayLoadF32;
+	case(Primitive::F64Primitive): return OpCode::OpArrayLoadF64;
+	default:
+		assert(false);
+		break;
 	}
-	m_opcodes.push_back(OpCode::OpCall);
+	return OpCode::OpNop;
 }
 
 void FunctionCompiler::visit(ast::ArrayAccessExpr* expr) {
@@ -5,6 +5,8 @@
 #include "opcodes.h"
 
 #include <assert.h>
+#include <atomic>
+#include <mutex>
 #include <vector>
 #include <unordered_map>
 #include <forward_list>
@@ -17,12 +19,54 @@ class Module;
 class Compiler;
 class ModuleCompiler;
 class CompilerAllocator;
+class ModuleCache;
+struct FunctionCode;
+
+
+/* \brief Built-in functions, they are declared in the global scope and lowered straight to opcodes.
+ */
+enum class Intrinsic : u8 {
+	NoIntrinsic,
+
+	ShuffleIntrinsic,
+	ReduceAddIntrinsic,
+	ReduceMinIntrinsic,
+	ReduceMaxIntrinsic,
+
+	// Array kernels, keep these in the same order as the OpArray<Kernel> opcode rows.
+	SumIntrinsic,
+	MinIntrinsic,
+	MaxIntrinsic,
+	DotIntrinsic,
+	AxpyIntrinsic,
+	ScaleIntrinsic,
+
+	SendIntrinsic,
+	RecvIntrinsic,
+
+	// Keep these in the same order as the OpAtomic<Operation> opcode pairs.
+	AtomicLoadIntrinsic,
+	AtomicStoreIntrinsic,
+	AtomicAddIntrinsic,
+	AtomicCasIntrinsic,
+
+	ParallelSumIntrinsic,
+	ParallelReduceIntrinsic,
+
+	IoReadIntrinsic,
+	IoWriteIntrinsic,
+	IoCloseIntrinsic,
+};
 
 
 namespace ast {
 
 	struct Type;
 	struct Callable;
+	struct StructType;
+	struct ArrayType;
+	struct ChannelType;
+	struct UnresolvedType;
 	struct Scope;
 
 	struct Node;
@@ -58,6 +102,10 @@ namespace ast {
 
 		bool is_callable() const { return (flags & CALLABLE) == CALLABLE; }
 		bool is_struct()   const { return (flags & STRUCT) == STRUCT; }
+		bool is_array()    const { return (flags & ARRAY) == ARRAY; }
+		bool is_unresolved() const { return (flags & UNRESOLVED) == UNRESOLVED; }
+		bool is_vector()   const { return (flags & VECTOR) == VECTOR; }
+		bool is_channel()  const { return (flags & CHANNEL) == CHANNEL; }
 		bool is_integer()  const { return (flags & INTEGER) == INTEGER; }
 		bool is_signed()   const { return (flags & SIGNED) == SIGNED; }
 		bool is_unsigned() const { return (flags & UNSIGNED) == UNSIGNED; }
@@ -72,6 +120,9 @@ namespace ast {
 				return size > target->size ? this : target;
 			return nullptr;
 		}
+		Primitive primitive() const { return (Primitive)(flags & PRIMITIVE_MASK); }
+		Type* get_lane_type_or_null() const;
+		i32 lane_count() const;
 
 	protected:
 		Type(u32 size, u32 flags)
@@ -79,14 +130,17 @@ namespace ast {
 
 		~Type() = default;
 
-		static const u32 PRIMITIVE_MASK = 0xF;
-		static const u32 INTEGER = 0x10;
-		static const u32 DECIMAL = 0x20;
+		static const u32 PRIMITIVE_MASK = 0x1F;
+		static const u32 INTEGER = 0x20;
+		static const u32 DECIMAL = 0x40;
 		static const u32 SIGNED = INTEGER;
-		static const u32 UNSIGNED = 0x40 & INTEGER;
-		static const u32 CALLABLE = 0x80;
-		static const u32 STRUCT = 0x100;
-		static const u32 UNRESOLVED = 0x200;
+		static const u32 UNSIGNED = 0x80 & INTEGER;
+		static const u32 CALLABLE = 0x100;
+		static const u32 STRUCT = 0x200;
+		static const u32 UNRESOLVED = 0x400;
+		static const u32 ARRAY = 0x800;
+		static const u32 VECTOR = 0x1000;
+		static const u32 CHANNEL = 0x2000;
 
 	};
 
@@ -101,6 +155,57 @@ namespace ast {
 		i32 arguments_count;
 	};
 
+	/*
+	 */
+	struct StructType : public Type {
+		static StructType* Create(CompilerAllocator* allocator, Struct* structure);
+
+		Struct* structure;
+
+		bool is_soa() const;
+
+	protected:
+		StructType(Struct* structure);
+	};
+
+	/* \brief ArrayType is the type of '[]<element type>', a reference to a sequence of elements.
+	 */
+	struct ArrayType : public Type {
+		static ArrayType* Create(CompilerAllocator* allocator, Type* element_type);
+
+		Type* element_type;
+
+	protected:
+		ArrayType(Type* element_type);
+	};
+
+	/* \brief ChannelType is the type of 'channel[<element type>]' or 'channel[<element type>, <capacity>]',
+	 * a reference to a bounded queue that IPA tasks use to pass values to each other.
+	 */
+	struct ChannelType : public Type {
+		static const u32 DEFAULT_CAPACITY = 64;
+
+		static ChannelType* Create(CompilerAllocator* allocator, Type* element_type, u32 capacity);
+
+		Type* element_type;
+		u32 capacity;
+
+	protected:
+		ChannelType(Type* element_type, u32 capacity);
+	};
+
+	/* \brief UnresolvedType is a placeholder for a type named by an identifier, filled out by the linker.
+	 */
+	struct UnresolvedType : public Type {
+		static UnresolvedType* Create(CompilerAllocator* allocator, const Token& name);
+
+		Token name;
+		Type* resolved_type;
+
+	protected:
+		UnresolvedType(const Token& name);
+	};
+
 	/*
 	 */
 	class Visitor {
@@ -219,6 +324,11 @@ namespace ast {
 		static const u32 LOCAL  = 0x2;
 		static const u32 MEMBER = 0x4;
 		static const u32 CONST  = 0x8;
+		static const u32 SOA    = 0x10;
+		// Set by escape analysis on locals whose storage may outlive the call.
+		static const u32 ESCAPES = 0x20;
+		// Set by @spsc on channels that only ever have one sending and one receiving task.
+		static const u32 SPSC    = 0x40;
 
 		Token name;
 		u32 decl_flags;
@@ -262,10 +372,12 @@ namespace ast {
 		static Struct* Create(CompilerAllocator* allocator, const Token& name);
 		
 		Scope* scope;
-		Type* type;
+		StructType* type;
+
+		i32 get_member_index_or_minus_one(Variable* member);
 
 	protected:
-		void init(const Token& name);
+		void init(CompilerAllocator* allocator, const Token& name);
 		~Struct() = delete;
 	};
 
@@ -283,6 +395,14 @@ namespace ast {
 
 		Block* body;
 		Function* next_overload;
+		Intrinsic intrinsic;
+
+		// The module the function was parsed in, it compiles the body on the first call.
+		ModuleCompiler* owner;
+		// Token of a body that was skipped over and is parsed on the first call, otherwise -1.
+		i32 lazy_body_token;
+		// Null until the function is first called, see FunctionCompiler::CodeFor.
+		std::atomic<const FunctionCode*> code;
 
 	protected:
 		void init(CompilerAllocator* allocator, const Token& name, Variable** arguments, i32 arguments_count, Type* return_type);
@@ -323,14 +443,15 @@ namespace ast {
 
 		static LoadExpr* CreateLoadVariable(CompilerAllocator* allocator, Variable* variable);
 		static LoadExpr* CreateLoadConstant(CompilerAllocator* allocator, const Token& constant);
-		static LoadExpr* CreateLoadMember(CompilerAllocator* allocator, Expr* structure, Variable* variable);
+		static LoadExpr* CreateLoadMember(CompilerAllocator* allocator, Expr* structure, const Token& member_name);
 
 		Token constant;
+		Token member_name;
 		Decl* loaded_decl;
 		Expr* structure_expr;
 
 	protected:
-		void init(const Token& constant, Variable* variable, Expr* structure_expr);
+		void init(const Token& constant, Variable* variable, Expr* structure_expr, const Token& member_name);
 		~LoadExpr() = delete;
 	};
 
@@ -364,6 +485,8 @@ namespace ast {
 		Variable* it_var;
 		Variable* index_var;
 		Block* block;
+		// Set by @parallel, iterations are split over the worker threads.
+		bool is_parallel;
 
 	protected:
 		void init(Expr* array_expr, Expr* low_expr, Expr* high_expr, Block* block);
@@ -418,14 +541,16 @@ namespace ast {
 	struct OperandExpr : public Expr {
 		static const u32 s_node_type = OPERAND_EXPR | Expr::s_node_type;
 
-		static OperandExpr* Create(CompilerAllocator* allocator, Operand operand, Expr* lhs, Expr* rhs);
+		static OperandExpr* Create(CompilerAllocator* allocator, Operand operand, Expr* lhs, Expr* rhs, const Token& token);
 
 		Operand operand;
 		Expr* lhs;
 		Expr* rhs;
+		// The operator, or the variable name for the store of an initialization. Errors point here.
+		Token token;
 
 	protected:
-		void init(Operand operand, Expr* lhs, Expr* rhs);
+		void init(Operand operand, Expr* lhs, Expr* rhs, const Token& token);
 		~OperandExpr() = delete;
 	};
 
@@ -435,14 +560,16 @@ namespace ast {
 	struct CallExpr : public Expr {
 		static const u32 s_node_type = CALL_EXPR | Expr::s_node_type;
 
-		static CallExpr* Create(CompilerAllocator* allocator, Expr* callable, Expr** arguments, i32 arguments_count);
+		static CallExpr* Create(CompilerAllocator* allocator, Expr* callable, Expr** arguments, i32 arguments_count, const Token& token);
 
 		Expr* callable;
 		Expr** arguments;
 		i32 arguments_count;
+		// Opening parenthesis of the call, errors point here.
+		Token token;
 
 	protected:
-		void init(CompilerAllocator* allocator, Expr* callable, Expr** arguments, i32 arguments_count);
+		void init(CompilerAllocator* allocator, Expr* callable, Expr** arguments, i32 arguments_count, const Token& token);
 		~CallExpr() = delete;
 	};
 
@@ -586,20 +713,26 @@ private:
 
 class Parser {
 public:
-	Parser(ModuleCompiler* module_compiler);
+	Parser(ModuleCompiler* module_compiler, Tokenizer& tokenizer);
 
 	void parse();
+	// Parses a body that parse skipped in lazy mode, the tokenizer has to be the one parse used.
+	void parse_lazy_body(ast::Function* function);
 
 private:
 
 	void parse_imports();
-	void parse_decleration();
+	void parse_attributes(std::vector<Token>& attributes);
+	void parse_decleration(const std::vector<Token>& leading_attributes = std::vector<Token>());
 	ast::Type* parse_type();
+	ast::Type* parse_channel_type();
 
 	ast::Block* parse_block();
+	// Steps over a block by its scope tokens without building anything.
+	void skip_block();
 
 	void parse_if_stmt(bool is_elif = false);
-	void parse_for_stmt();
+	void parse_for_stmt(const std::vector<Token>& attributes = std::vector<Token>());
 	void parse_while_stmt();
 	void parse_return_stmt();
 
@@ -620,6 +753,7 @@ private:
 	Token optional(Operand data);
 
 	void required_stmt_end_or_raise_garbage_error_and_continue_after_line();
+	CompilerError* raise_error();
 	CompilerError* raise_error_and_continue();
 	CompilerError* raise_error_and_stop();
 	CompilerError* raise_error_and_continue_after_line();
@@ -649,7 +783,8 @@ private:
 
 	Project* m_project;
 	ModuleCompiler* m_module_compiler;
-	Tokenizer m_tokenizer;
+	Tokenizer& m_tokenizer;
+	bool m_lazy_bodies;
 
 	CompilerAllocator* m_allocator;
 
@@ -663,6 +798,8 @@ public:
 		: m_module_compiler(module_compiler) { }
 
 	void infer_types();
+	// Infers a body parsed after the rest of its module was inferred.
+	void infer_lazy_body(ast::Function* function);
 
 	bool mark_visited(ast::Node* node);
 	void jump_to(ast::Node* node);
@@ -674,7 +811,11 @@ public:
 	virtual void visit(ast::Function* funnction) override;
 	virtual void visit(ast::Block* block) override;
 
+	virtual void visit(ast::IfStmt* stmt) override;
+	virtual void visit(ast::ForStmt* stmt) override;
+	virtual void visit(ast::WhileStmt* stmt) override;
 	virtual void visit(ast::ReturnStmt* expr) override;
+	virtual void visit(ast::ExprStmt* expr) override;
 
 	virtual void visit(ast::LoadExpr* expr) override;
 	virtual void visit(ast::OperandExpr* expr) override;
@@ -682,18 +823,44 @@ public:
 	virtual void visit(ast::ArrayAccessExpr* expr) override;
 	virtual void visit(ast::CastExpr* expr) override;
 
+	ast::Type* resolve_type(ast::Type* type);
+
 private:
+	void infer_vector_operand_expr(ast::OperandExpr* expr);
+	// Number literals have no type of their own yet, they take the type they are used as.
+	// Returns whether expr has the type afterwards.
+	bool coerce_to_type(ast::Expr* expr, ast::Type* type);
+	void infer_intrinsic_call(ast::CallExpr* expr, Intrinsic intrinsic);
+	void infer_array_intrinsic_call(ast::CallExpr* expr, Intrinsic intrinsic);
+	void infer_channel_intrinsic_call(ast::CallExpr* expr, Intrinsic intrinsic);
+	void infer_atomic_intrinsic_call(ast::CallExpr* expr, Intrinsic intrinsic);
+	void infer_parallel_intrinsic_call(ast::CallExpr* expr, Intrinsic intrinsic);
+	void infer_io_intrinsic_call(ast::CallExpr* expr, Intrinsic intrinsic);
+
+	bool is_declared_in_parallel_loop(ast::Variable* variable) const;
+
 	ModuleCompiler* m_module_compiler;
+	i32 m_parallel_loop_depth = 0;
+	// Locals of the @parallel loop bodies being inferred, the innermost body's start at the first index.
+	std::vector<ast::Variable*> m_parallel_loop_locals;
+	size_t m_parallel_loop_first_local = 0;
 };
 
 
 class ModuleCompiler {
 public:
 	static ModuleCompiler* Create(Compiler* compiler, Module* module);
-	~ModuleCompiler() {}
+	~ModuleCompiler();
 
+	// Tokens are kept when they are printed before parsing or lazy bodies seek back to them, otherwise
+	// parsing streams them. Parsing uses the tokenizer created here, or creates one itself.
+	Tokenizer* create_tokenizer(bool keep_tokens);
 	void parse_and_link_internals();
 	void infer_types_and_do_semantic_analysis();
+	bool is_parsed() const { return m_is_parsed; }
+	bool is_analyzed() const { return m_is_analyzed; }
+	// Throws away everything compiled for the module, including its source, to compile it again from scratch.
+	void reset();
 
 	ast::Scope* scope() { return m_scope; }
 	Source* source() { return &m_source; }
@@ -703,19 +870,44 @@ public:
 	CompilerAllocator* allocator() { return &m_allocator; }
 
 	void add_link(ast::LoadExpr* load_expr, ast::Scope* scope, const Token& name);
+	void add_link(ast::UnresolvedType* type, ast::Scope* scope);
+	// Resolves what parse_and_link_internals left over against the imported modules, which have to
+	// be parsed by then. Names that are declared nowhere are reported here.
+	void link_imports();
+	// Runs the FunctionCompiler over one of this module's functions unless another thread already did.
+	// A body skipped in lazy mode is parsed, linked and inferred first, null when that raised errors.
+	const FunctionCode* compile_function(ast::Function* function);
 
 	void import(Module* module, const Token& as = Token());
 	void import_from(Module* module, const Token& identifier, const Token& as = Token());
 	void import_everything(Module* module);
+	// Modules this one imports from, they are inferred before this one and a change to any of them
+	// invalidates its cache entry.
+	const std::vector<Module*>& dependencies() const { return m_dependencies; }
 
 	CompilerError* raise_error();
 	bool encountered_error() const { return !m_errors.empty(); }
 	void print_errors(std::ostream& stream);
 
 private:
+	// A name brought in by from-import, an empty identifier stands for import *.
+	struct Import {
+		Module* module;
+		Token identifier;
+		Token as;
+	};
+
 	ModuleCompiler(Module* module, Compiler* compiler);
 
+	void add_dependency(Module* module);
+	// Resolves the links from first_link on in their own scopes, the rest goes to m_external_links.
+	void link_internals(i32 first_link);
+	void link_externals();
+	bool parse_lazy_body(ast::Function* function);
+
 	Source m_source;
+	// Kept after parsing in lazy mode, skipped bodies are parsed from its tokens later.
+	Tokenizer* m_tokenizer = nullptr;
 	ast::Scope* m_scope;
 	Module* m_module;
 	Compiler* m_compiler;
@@ -723,7 +915,17 @@ private:
 	CompilerAllocator m_allocator;
 
 	std::vector<Link> m_unresolved_links;
+	std::vector<Link*> m_external_links;
+	std::vector<Import> m_imports;
+	std::vector<Module*> m_dependencies;
 	std::vector<CompilerError*> m_errors;
+
+	// Functions are compiled on the threads that first call them.
+	std::mutex m_functions_mutex;
+	std::vector<FunctionCode*> m_function_codes;
+
+	bool m_is_parsed = false;
+	bool m_is_analyzed = false;
 };
 
  
@@ -734,24 +936,32 @@ public:
 	~Compiler();
 
 	void compile();
+	// Compiles the changed modules again together with everything that depends on them, the other
+	// modules keep what they have. Errors are reported for the whole project afterwards, as after compile.
+	void recompile(const std::vector<Module*>& changed_modules);
 
 	ast::Scope* global_scope() { return m_global_scope; }
 	CompilerAllocator* allocator() { return &m_allocator; }
-
-	void add_link(Link* link);
+	ModuleCompiler* module_compiler_or_null(Module* module) const;
 
 	CompilerError* raise_error();
 	void mark_encoutered_error() { m_encountered_errors = true; }
 	bool encountered_error() { return m_encountered_errors; }
 	void print_errors(std::ostream& stream);
 
-	Module* resolve_module(const std::string& path);
+	// Finds path.ipa in the source folders, or next to relative_to for a relative import. Called by the
+	// parsers of all modules at once, found modules are compiled after the modules that import them are parsed.
+	Module* resolve_module(const std::string& path, Module* relative_to = nullptr);
 
 
 private:
+	void declare_intrinsics();
+	void compile_modules(const std::vector<ModuleCompiler*>& module_compilers, ModuleCache* cache);
+	// Returns the modules imported by module_compilers that are not parsed yet, creating compilers for new ones.
+	std::vector<ModuleCompiler*> unparsed_imports(const std::vector<ModuleCompiler*>& module_compilers);
+
 	std::unordered_map<Module*, ModuleCompiler*> m_module_to_module_compilers;
 	std::vector<ModuleCompiler*> m_module_compilers;
-	int m_module_compilers_index = 0;
 
 	ast::Scope* m_global_scope;
 	Project* m_project;
@@ -759,20 +969,68 @@ private:
 
 	CompilerAllocator m_allocator;
 
-	std::vector<Link> m_unresolved_links;
+	// Guards the modules of the project while parsers resolve imports.
+	std::mutex m_modules_mutex;
 
-	bool m_encountered_errors;
+	// Modules are parsed and inferred on several threads at once.
+	std::atomic<bool> m_encountered_errors;
 	std::vector<CompilerError*> m_errors;
 };
 
 
+/* \brief Marks struct locals with ESCAPES when a reference to them can outlive the call.
+ * Only member reads and writes keep a local in its frame, any other use of the variable itself
+ * (returning it, passing it to a call, storing it somewhere) is treated as an escape.
+ */
+class EscapeAnalyzer : public ast::Visitor {
+public:
+	void analyze(ast::Function* function);
+	// The locals of every block analyze walked through, outer blocks first.
+	const std::vector<ast::Variable*>& locals() const { return m_locals; }
+
+	void visit(ast::Block* block) override;
+
+	void visit(ast::IfStmt* stmt) override;
+	void visit(ast::ForStmt* stmt) override;
+	void visit(ast::WhileStmt* stmt) override;
+	void visit(ast::ReturnStmt* stmt) override;
+	void visit(ast::ExprStmt* stmt) override;
+
+	void visit(ast::LoadExpr* expr) override;
+	void visit(ast::OperandExpr* expr) override;
+	void visit(ast::CallExpr* expr) override;
+	void visit(ast::ArrayAccessExpr* expr) override;
+	void visit(ast::CastExpr* expr) override;
+
+private:
+	std::vector<ast::Variable*> m_locals;
+};
+
+/* \brief The bytecode of one function body.
+ */
+struct FunctionCode {
+	std::vector<u8> code;
+	// Arguments, locals and hidden slots, the frame is this many slots large.
+	i32 slot_count;
+};
+
+
+/* \brief Lowers the typed body of one function to bytecode.
+ * Nothing is compiled up front, OpCall and Runtime::call get the code of their callee through CodeFor,
+ * which compiles a body the first time anything calls it and hands out the same code ever after.
+ */
 class FunctionCompiler : public ast::Visitor {
 public:
 	FunctionCompiler(ast::Function* function)
 		: m_function(function)
 	{}
 
+	// Null for functions without a body, which are the intrinsics.
+	static const FunctionCode* CodeFor(ast::Function* function);
+
 	void compile();
+	std::vector<u8>& code() { return m_code; }
+	i32 slot_count() const { return (i32)m_local_slots.size(); }
 
 	void visit(ast::Function* funnction) override;
 	void visit(ast::Block* block) override;
@@ -791,10 +1049,38 @@ public:
 	void visit(ast::CastExpr* expr) override;
 
 private:
+	void emit(OpCode opcode) { m_code.push_back((u8)opcode); }
+	void emit_u8(u8 value) { m_code.push_back(value); }
+	void emit_u32(u32 value) { for (i32 i = 0; i < 4; i++) emit_u8((u8)(value >> (i * 8))); }
+	void emit_u64(u64 value) { for (i32 i = 0; i < 8; i++) emit_u8((u8)(value >> (i * 8))); }
+	// Reserves an i16 jump offset and returns where it lives, patch it once the target is known.
+	i32 emit_jump_offset();
+	void patch_jump_offset(i32 offset_position, i32 target);
+
+	// Frees the channels of the frame, before anything that leaves it.
+	void emit_frame_exit();
+
+	// Reserves as many consecutive slots as the variable's type takes and returns the first.
+	u8 allocate_local_slot(ast::Variable* variable);
+	i32 get_local_slot_or_minus_one(ast::Variable* variable);
+	i32 get_slot_count(ast::Type* type);
+
+	bool is_tail_call(ast::CallExpr* expr);
+	void compile_intrinsic_call(ast::CallExpr* expr, Intrinsic intrinsic);
+	void compile_array_intrinsic_call(ast::CallExpr* expr, Intrinsic intrinsic);
+	void compile_atomic_intrinsic_call(ast::CallExpr* expr, Intrinsic intrinsic);
+	void compile_parallel_intrinsic_call(ast::CallExpr* expr, Intrinsic intrinsic);
+	OpCode get_array_load_opcode(ast::Type* element_type);
+	OpCode get_local_load_opcode(ast::Type* type);
+	OpCode get_vector_opcode(Operand operand, ast::Type* type);
+
 	ast::Function* m_function;
 
-	bool m_expression_returned_64_bits = false;
-	std::vector<OpCode> m_opcodes;
+	std::vector<u8> m_code;
+	// Index is the slot, hidden slots such as the end of a range loop have no variable.
+	std::vector<ast::Variable*> m_local_slots;
+	// Slots of the channels the prologue created.
+	std::vector<u8> m_frame_channel_slots;
 };
 
 
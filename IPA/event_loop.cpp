@@ -0,0 +1,258 @@
+#include "event_loop.h"
+#include "fiber.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <vector>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+
+#ifdef __linux__
+
+// Ready descriptors taken from the kernel per epoll_wait call.
+static const i32 MAX_EVENTS = 64;
+
+EventLoop::EventLoop() {
+	m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	assert(m_epoll_fd >= 0);
+	m_interrupt_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	assert(m_interrupt_fd >= 0);
+
+	epoll_event event = {};
+	event.events = EPOLLIN;
+	event.data.fd = m_interrupt_fd;
+	epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_interrupt_fd, &event);
+}
+
+EventLoop::~EventLoop() {
+	for (auto& it : m_descriptors)
+		restore_flags(it.first, it.second);
+	::close(m_interrupt_fd);
+	::close(m_epoll_fd);
+}
+
+bool EventLoop::read_or_park(Fiber* fiber, i32 fd, void* data, i64 count, i64& result) {
+	prepare(fd);
+	ssize_t bytes = ::read(fd, data, (size_t)count);
+	if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+		i32 error = park(fiber, fd, READABLE);
+		if (error == 0)
+			return false;
+		result = error;
+		return true;
+	}
+	result = bytes < 0 ? -errno : bytes;
+	return true;
+}
+
+bool EventLoop::write_or_park(Fiber* fiber, i32 fd, const void* data, i64 count, i64& result) {
+	prepare(fd);
+	ssize_t bytes = ::write(fd, data, (size_t)count);
+	if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+		i32 error = park(fiber, fd, WRITABLE);
+		if (error == 0)
+			return false;
+		result = error;
+		return true;
+	}
+	result = bytes < 0 ? -errno : bytes;
+	return true;
+}
+
+i32 EventLoop::close(i32 fd) {
+	std::vector<Fiber*> waiters;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto it = m_descriptors.find(fd);
+		if (it != m_descriptors.end()) {
+			Descriptor& descriptor = it->second;
+			waiters.insert(waiters.end(), descriptor.readers.begin(), descriptor.readers.end());
+			waiters.insert(waiters.end(), descriptor.writers.begin(), descriptor.writers.end());
+			if (descriptor.is_registered)
+				epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+			restore_flags(fd, descriptor);
+			m_descriptors.erase(it);
+		}
+	}
+	i32 result = ::close(fd) < 0 ? -errno : 0;
+	for (auto fiber : waiters)
+		fiber->scheduler->wake(fiber);
+	return result;
+}
+
+i32 EventLoop::poll(i32 timeout_ms) {
+	epoll_event events[MAX_EVENTS];
+	i32 event_count = epoll_wait(m_epoll_fd, events, MAX_EVENTS, timeout_ms);
+	if (event_count <= 0)
+		return 0;
+
+	std::vector<Fiber*> ready;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (i32 i = 0; i < event_count; i++) {
+			i32 fd = events[i].data.fd;
+			if (fd == m_interrupt_fd) {
+				u64 value;
+				while (::read(m_interrupt_fd, &value, sizeof(value)) > 0) {}
+				continue;
+			}
+
+			auto it = m_descriptors.find(fd);
+			if (it == m_descriptors.end())
+				continue;
+			Descriptor& descriptor = it->second;
+			// Readiness wakes the first waiter of a side, the registration is level triggered so the next
+			// one is woken by the re-arm below if there is still data or room left. Errors and hang ups wake
+			// every waiter, their retry reports what happened.
+			u32 flags = events[i].events;
+			bool is_failed = (flags & (EPOLLHUP | EPOLLERR)) != 0;
+			if (!descriptor.readers.empty() && (flags & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))) {
+				do {
+					ready.push_back(descriptor.readers.front());
+					descriptor.readers.pop_front();
+				} while (is_failed && !descriptor.readers.empty());
+			}
+			if (!descriptor.writers.empty() && (flags & (EPOLLOUT | EPOLLHUP | EPOLLERR))) {
+				do {
+					ready.push_back(descriptor.writers.front());
+					descriptor.writers.pop_front();
+				} while (is_failed && !descriptor.writers.empty());
+			}
+			// One shot registrations are disabled after firing, re-arm for the fibers still waiting. Should
+			// that fail they are all woken, their retry parks again and gets the error from arming.
+			if ((!descriptor.readers.empty() || !descriptor.writers.empty()) && arm(fd, descriptor) < 0) {
+				ready.insert(ready.end(), descriptor.readers.begin(), descriptor.readers.end());
+				ready.insert(ready.end(), descriptor.writers.begin(), descriptor.writers.end());
+				descriptor.readers.clear();
+				descriptor.writers.clear();
+			}
+		}
+	}
+
+	for (auto fiber : ready)
+		fiber->scheduler->wake(fiber);
+	return (i32)ready.size();
+}
+
+void EventLoop::interrupt() {
+	u64 value = 1;
+	ssize_t written = ::write(m_interrupt_fd, &value, sizeof(value));
+	(void)written;
+}
+
+void EventLoop::prepare(i32 fd) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_descriptors.count(fd))
+		return;
+	Descriptor& descriptor = m_descriptors[fd];
+	i32 flags = fcntl(fd, F_GETFL);
+	if (flags >= 0 && !(flags & O_NONBLOCK) && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0)
+		descriptor.original_flags = flags;
+}
+
+i32 EventLoop::park(Fiber* fiber, i32 fd, u32 interest) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	Descriptor& descriptor = m_descriptors[fd];
+	if (interest & READABLE)
+		descriptor.readers.push_back(fiber);
+	if (interest & WRITABLE)
+		descriptor.writers.push_back(fiber);
+	// Level triggered, so readiness that arrived since the failed attempt is reported right away.
+	i32 error = arm(fd, descriptor);
+	if (error < 0) {
+		if (interest & READABLE)
+			descriptor.readers.pop_back();
+		if (interest & WRITABLE)
+			descriptor.writers.pop_back();
+	}
+	return error;
+}
+
+i32 EventLoop::arm(i32 fd, Descriptor& descriptor) {
+	epoll_event event = {};
+	event.events = EPOLLONESHOT;
+	if (!descriptor.readers.empty()) event.events |= EPOLLIN | EPOLLRDHUP;
+	if (!descriptor.writers.empty()) event.events |= EPOLLOUT;
+	event.data.fd = fd;
+	if (descriptor.is_registered) {
+		if (epoll_ctl(m_epoll_fd, EPOLL_CTL_MOD, fd, &event) < 0)
+			return -errno;
+	} else {
+		if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0)
+			return -errno;
+		descriptor.is_registered = true;
+	}
+	return 0;
+}
+
+void EventLoop::restore_flags(i32 fd, const Descriptor& descriptor) {
+	if (descriptor.original_flags >= 0)
+		fcntl(fd, F_SETFL, descriptor.original_flags);
+}
+
+#else
+
+EventLoop::EventLoop()
+	: m_epoll_fd(-1), m_interrupt_fd(-1) {}
+
+EventLoop::~EventLoop() {}
+
+#ifdef _WIN32
+#define IPA_READ  _read
+#define IPA_WRITE _write
+#define IPA_CLOSE _close
+#else
+#define IPA_READ  ::read
+#define IPA_WRITE ::write
+#define IPA_CLOSE ::close
+#endif
+
+bool EventLoop::read_or_park(Fiber* fiber, i32 fd, void* data, i64 count, i64& result) {
+	i64 bytes = IPA_READ(fd, data, (u32)count);
+	result = bytes < 0 ? -errno : bytes;
+	return true;
+}
+
+bool EventLoop::write_or_park(Fiber* fiber, i32 fd, const void* data, i64 count, i64& result) {
+	i64 bytes = IPA_WRITE(fd, data, (u32)count);
+	result = bytes < 0 ? -errno : bytes;
+	return true;
+}
+
+i32 EventLoop::close(i32 fd) {
+	return IPA_CLOSE(fd) < 0 ? -errno : 0;
+}
+
+i32 EventLoop::poll(i32 timeout_ms) {
+	std::unique_lock<std::mutex> lock(m_mutex);
+	auto interrupted = [this]() { return m_interrupt_pending; };
+	if (timeout_ms < 0)
+		m_interrupted.wait(lock, interrupted);
+	else
+		m_interrupted.wait_for(lock, std::chrono::milliseconds(timeout_ms), interrupted);
+	m_interrupt_pending = false;
+	return 0;
+}
+
+void EventLoop::interrupt() {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_interrupt_pending = true;
+	m_interrupted.notify_all();
+}
+
+void EventLoop::prepare(i32 fd) {}
+i32 EventLoop::park(Fiber* fiber, i32 fd, u32 interest) { return 0; }
+i32 EventLoop::arm(i32 fd, Descriptor& descriptor) { return 0; }
+void EventLoop::restore_flags(i32 fd, const Descriptor& descriptor) {}
+
+#endif
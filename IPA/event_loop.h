@@ -0,0 +1,73 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+#include "common.h"
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+
+class Fiber;
+
+
+/* \brief Waits on file descriptors for the fibers of one scheduler, backed by epoll on Linux.
+ * The io built-ins try the operation on a non-blocking descriptor first and only when it would block
+ * park the fiber here, poll wakes it through its scheduler once the descriptor is ready so it can retry.
+ * Elsewhere the descriptors are used as they are and every operation simply blocks its thread.
+ */
+class EventLoop
+{
+public:
+	static const u32 READABLE = 1;
+	static const u32 WRITABLE = 2;
+
+	EventLoop();
+	~EventLoop();
+
+	// Used by the interpreter for OpIoRead and OpIoWrite. On success result is the byte count, zero at
+	// the end of a stream, or a negative errno, which is also what a descriptor that can not be waited on
+	// gives. When the descriptor is not ready the fiber is parked and false is returned, the interpreter
+	// then suspends the fiber without advancing its pc.
+	bool read_or_park(Fiber* fiber, i32 fd, void* data, i64 count, i64& result);
+	bool write_or_park(Fiber* fiber, i32 fd, const void* data, i64 count, i64& result);
+	// Backs OpIoClose, fibers still waiting on the descriptor are woken and see the error on their retry.
+	// The descriptor gets back the flags it had before the loop first used it.
+	i32 close(i32 fd);
+
+	// Waits up to timeout_ms for ready descriptors, -1 waits until interrupt, and wakes their fibers.
+	// Returns the number of fibers woken.
+	i32 poll(i32 timeout_ms);
+	// Makes a poll that is waiting on another thread return.
+	void interrupt();
+
+private:
+	struct Descriptor {
+		// Fibers waiting for each side, woken in the order they parked.
+		std::deque<Fiber*> readers;
+		std::deque<Fiber*> writers;
+		// Flags before the switch to non-blocking, the descriptor may be shared with other processes
+		// such as the shell that started us, so they are restored on close and when the loop goes away.
+		i32 original_flags = -1;
+		bool is_registered = false;
+	};
+
+	// Switches fd to non-blocking the first time it is used.
+	void prepare(i32 fd);
+	// Returns 0, or a negative errno when the descriptor can not be waited on and the fiber was not parked.
+	i32 park(Fiber* fiber, i32 fd, u32 interest);
+	i32 arm(i32 fd, Descriptor& descriptor);
+	void restore_flags(i32 fd, const Descriptor& descriptor);
+
+	i32 m_epoll_fd;
+	i32 m_interrupt_fd;
+
+	std::mutex m_mutex;
+	std::map<i32, Descriptor> m_descriptors;
+
+	// Without epoll nothing is ever parked and poll only sleeps until it is interrupted.
+	std::condition_variable m_interrupted;
+	bool m_interrupt_pending = false;
+};
+
+
+#endif // EVENT_LOOP_H
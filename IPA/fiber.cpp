@@ -0,0 +1,136 @@
+#include "fiber.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <string.h>
+
+
+Fiber::Fiber(ast::Function* entry, u64 id)
+	: id(id), state(FiberState::Runnable), scheduler(nullptr), function(entry), pc(0), frame_arena(INITIAL_FRAME_ARENA_SIZE) {
+	m_stack = new Slot[INITIAL_STACK_SLOTS];
+	m_stack_size = INITIAL_STACK_SLOTS;
+	stack_ptr = m_stack;
+}
+
+Fiber::~Fiber() {
+	delete[] m_stack;
+}
+
+void Fiber::ensure_stack(i64 slot_count) {
+	i64 used = stack_ptr - m_stack;
+	if (used + slot_count <= m_stack_size)
+		return;
+
+	i64 new_size = m_stack_size * 2;
+	while (new_size < used + slot_count) new_size *= 2;
+	Slot* new_stack = new Slot[new_size];
+	memcpy(new_stack, m_stack, used * sizeof(Slot));
+	delete[] m_stack;
+
+	m_stack = new_stack;
+	m_stack_size = new_size;
+	stack_ptr = m_stack + used;
+}
+
+
+FiberScheduler::FiberScheduler(Project* project, const Resume& resume, i32 thread_count)
+	: m_resume(resume), m_live_fibers(0), m_next_fiber_id(1), m_stop(false), m_io_stop(false) {
+	if (thread_count <= 0) {
+		thread_count = (i32)std::thread::hardware_concurrency();
+		if (thread_count <= 0) thread_count = 1;
+	}
+	for (i32 i = 0; i < thread_count; i++)
+		m_runtimes.push_back(new Runtime(project));
+	for (i32 i = 0; i < thread_count; i++)
+		m_threads.emplace_back(&FiberScheduler::thread_loop, this, i);
+	m_io_thread = std::thread(&FiberScheduler::io_loop, this);
+}
+
+FiberScheduler::~FiberScheduler() {
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_fiber_ready.notify_all();
+	for (auto& thread : m_threads)
+		thread.join();
+	m_io_stop = true;
+	m_event_loop.interrupt();
+	m_io_thread.join();
+	for (auto runtime : m_runtimes)
+		delete runtime;
+	// Runnable ones as well as the ones suspended on a channel or descriptor.
+	for (auto fiber : m_fibers)
+		delete fiber;
+}
+
+Fiber* FiberScheduler::spawn(ast::Function* entry) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	Fiber* fiber = new Fiber(entry, m_next_fiber_id++);
+	fiber->scheduler = this;
+	m_fibers.insert(fiber);
+	++m_live_fibers;
+	m_run_queue.push_back(fiber);
+	m_fiber_ready.notify_one();
+	return fiber;
+}
+
+void FiberScheduler::wake(Fiber* fiber) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (fiber->state == FiberState::Suspended) {
+		fiber->state = FiberState::Runnable;
+		m_run_queue.push_back(fiber);
+		m_fiber_ready.notify_one();
+	} else if (fiber->state == FiberState::Running) {
+		m_early_wakes.push_back(fiber);
+	}
+}
+
+void FiberScheduler::wait_until_finished() {
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_all_finished.wait(lock, [this]() { return m_live_fibers == 0; });
+}
+
+void FiberScheduler::thread_loop(i32 thread_index) {
+	Runtime& runtime = *m_runtimes[thread_index];
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (true) {
+		m_fiber_ready.wait(lock, [this]() { return m_stop || !m_run_queue.empty(); });
+		if (m_stop)
+			return;
+
+		Fiber* fiber = m_run_queue.front();
+		m_run_queue.pop_front();
+		fiber->state = FiberState::Running;
+
+		lock.unlock();
+		runtime.set_running_fiber(fiber);
+		FiberState state = m_resume(*fiber, runtime);
+		runtime.set_running_fiber(nullptr);
+		lock.lock();
+
+		auto early_wake = std::find(m_early_wakes.begin(), m_early_wakes.end(), fiber);
+		if (early_wake != m_early_wakes.end()) {
+			m_early_wakes.erase(early_wake);
+			if (state == FiberState::Suspended)
+				state = FiberState::Runnable;
+		}
+
+		fiber->state = state;
+		if (state == FiberState::Runnable) {
+			// Yielded, go to the back so every other fiber gets a turn first.
+			m_run_queue.push_back(fiber);
+			m_fiber_ready.notify_one();
+		} else if (state == FiberState::Finished) {
+			m_fibers.erase(fiber);
+			delete fiber;
+			if (--m_live_fibers == 0)
+				m_all_finished.notify_all();
+		}
+	}
+}
+
+void FiberScheduler::io_loop() {
+	while (!m_io_stop)
+		m_event_loop.poll(-1);
+}
@@ -0,0 +1,115 @@
+#ifndef FIBER_H
+#define FIBER_H
+#include "common.h"
+#include "runtime.h"
+#include "event_loop.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+
+
+class FiberScheduler;
+
+enum class FiberState : u8 {
+	Runnable,
+	Running,
+	// Waiting for something outside the fiber, FiberScheduler::wake makes it runnable again.
+	Suspended,
+	Finished,
+};
+
+/* \brief One IPA execution with its own operand stack, many of them share a single OS thread.
+ * Switching fibers only saves the interpreter registers below, there is no OS context switch.
+ * The stack starts at a couple of kilobytes and doubles when a call needs more, so frames have
+ * to address their slots relative to stack_begin() rather than holding pointers into it.
+ */
+class Fiber
+{
+public:
+	static const i32 INITIAL_STACK_SLOTS = 256;
+	static const i64 INITIAL_FRAME_ARENA_SIZE = 1024;
+
+	Fiber(ast::Function* entry, u64 id);
+	~Fiber();
+
+	Slot* stack_begin() const { return m_stack; }
+	Slot* stack_end() const { return m_stack + m_stack_size; }
+	// Makes room for slot_count more slots above stack_ptr, the stack may move.
+	void ensure_stack(i64 slot_count);
+
+	const u64 id;
+	FiberState state;
+	// The scheduler the fiber was spawned on, whatever the fiber waits on wakes it through it.
+	FiberScheduler* scheduler;
+
+	// Interpreter registers, saved whenever the fiber yields or suspends.
+	ast::Function* function;
+	i32 pc;
+	Slot* stack_ptr;
+
+	// Frames of different fibers interleave on a thread, so each fiber resets its own arena. The runtime
+	// resuming the fiber allocates its frames here, see Runtime::set_running_fiber.
+	FrameArena frame_arena;
+
+private:
+	Slot* m_stack;
+	i64 m_stack_size;
+};
+
+/* \brief Runs fibers on a small number of OS threads, M fibers on N threads.
+ * Every thread owns a Runtime and repeatedly takes a runnable fiber off the shared queue and
+ * resumes it until it yields, suspends or finishes. One more thread polls the event loop and
+ * wakes the fibers whose descriptors became ready.
+ */
+class FiberScheduler
+{
+public:
+	// Runs the fiber until it gives up the thread and returns the state it should be left in.
+	typedef std::function<FiberState(Fiber& fiber, Runtime& runtime)> Resume;
+
+	// A thread count of zero uses one thread per hardware thread.
+	FiberScheduler(Project* project, const Resume& resume, i32 thread_count = 0);
+	~FiberScheduler();
+
+	Fiber* spawn(ast::Function* entry);
+	// Makes a suspended fiber runnable again, may be called from any thread and from inside fibers.
+	void wake(Fiber* fiber);
+	// Blocks until every spawned fiber finished.
+	void wait_until_finished();
+
+	i64 live_fiber_count() const { return m_live_fibers; }
+
+	EventLoop& event_loop() { return m_event_loop; }
+
+private:
+	void thread_loop(i32 thread_index);
+	void io_loop();
+
+	Resume m_resume;
+	std::vector<Runtime*> m_runtimes;
+	std::vector<std::thread> m_threads;
+
+	std::mutex m_mutex;
+	std::condition_variable m_fiber_ready;
+	std::condition_variable m_all_finished;
+	std::deque<Fiber*> m_run_queue;
+	// Wakes that arrive while their fiber is still running, applied once it is switched out.
+	std::vector<Fiber*> m_early_wakes;
+	// Every fiber spawned and not finished yet, wherever it is, so they can be deleted at shutdown.
+	std::unordered_set<Fiber*> m_fibers;
+	i64 m_live_fibers;
+	u64 m_next_fiber_id;
+	bool m_stop;
+
+	EventLoop m_event_loop;
+	std::thread m_io_thread;
+	std::atomic<bool> m_io_stop;
+};
+
+
+#endif // FIBER_H
@@ -1,6 +1,7 @@
 #include "project.h"
 #include "compiler.h"
 #include "runtime.h"
+#include "watch_server.h"
 
 #include "ast_printer.h"
 #include "opcode_printer.h"
@@ -10,6 +11,8 @@
 
 int main(int argc, char* argv[])
 {
+	ast::Type::InitializePrimitveTypes();
+
 	Project project(argc, argv);
 	Runtime runtime(&project);
 
@@ -17,6 +20,12 @@ int main(int argc, char* argv[])
 		Compiler compiler(&project, &runtime);
 
 		compiler.compile();
+		if (project.settings().watch) {
+			if (compiler.encountered_error())
+				compiler.print_errors(std::cout);
+			WatchServer server(&project, &compiler);
+			return server.run();
+		}
 		if (compiler.encountered_error()) {
 			compiler.print_errors(std::cout);
 			return -1;
@@ -0,0 +1,141 @@
+#include "module_cache.h"
+#include "project.h"
+#include "tokenizer.h"
+
+#include <fstream>
+#include <stdio.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+static const u32 ENTRY_MAGIC = 0x43415049; // "IPAC"
+// Anything longer means the entry is damaged.
+static const u32 MAX_PATH_LENGTH = 4096;
+
+static const u64 FNV_OFFSET = 14695981039346656037ull;
+static const u64 FNV_PRIME  = 1099511628211ull;
+
+static u64 hash_bytes(u64 hash, const void* data, i64 size) {
+	const u8* bytes = (const u8*)data;
+	for (i64 i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= FNV_PRIME;
+	}
+	return hash;
+}
+
+template<typename T>
+static u64 hash_value(u64 hash, const T& value) {
+	return hash_bytes(hash, &value, sizeof(T));
+}
+
+
+ModuleCache::ModuleCache(const std::string& folder, const Settings& settings)
+	: m_folder(folder) {
+	u32 version = VERSION;
+	u64 hash = hash_value(FNV_OFFSET, version);
+	// Errors in bodies that are never called are only reported without lazy bodies.
+	hash = hash_value(hash, settings.lazy_bodies);
+	m_settings_hash = hash;
+
+#ifdef _WIN32
+	_mkdir(m_folder.c_str());
+#else
+	mkdir(m_folder.c_str(), 0755);
+#endif
+}
+
+u64 ModuleCache::add(const Source* source) {
+	u64 key = hash_bytes(m_settings_hash, source->start(), source->end() - source->start());
+	m_keys[source->path()] = key;
+	return key;
+}
+
+u64 ModuleCache::key_of(const std::string& path) {
+	auto it = m_keys.find(path);
+	if (it != m_keys.end())
+		return it->second;
+
+	// A dependency that is not part of this compilation, a file that is gone gets a key no entry has.
+	Source source(path);
+	if (!source.is_loaded())
+		return m_keys[path] = 0;
+	return add(&source);
+}
+
+bool ModuleCache::is_up_to_date(const std::string& path) {
+	auto it = m_up_to_date.find(path);
+	if (it != m_up_to_date.end())
+		return it->second;
+	m_up_to_date[path] = true;
+
+	Entry entry;
+	bool up_to_date = read_entry(path, entry) && entry.key == key_of(path);
+	for (i32 i = 0; up_to_date && i < (i32)entry.dependencies.size(); i++) {
+		const Dependency& dependency = entry.dependencies[i];
+		up_to_date = dependency.key == key_of(dependency.path) && is_up_to_date(dependency.path);
+	}
+	return m_up_to_date[path] = up_to_date;
+}
+
+void ModuleCache::store(const std::string& path, const std::vector<Dependency>& dependencies) {
+	// Written next to the entry and renamed over it, so an interrupted write never leaves half an entry.
+	std::string final_path = entry_path(path);
+	std::string temporary_path = final_path + ".tmp";
+	{
+		std::ofstream stream(temporary_path, std::ios::binary | std::ios::trunc);
+		if (!stream)
+			return;
+
+		auto write_u32 = [&](u32 value) { stream.write((const char*)&value, sizeof(value)); };
+		auto write_u64 = [&](u64 value) { stream.write((const char*)&value, sizeof(value)); };
+		write_u32(ENTRY_MAGIC);
+		write_u32(VERSION);
+		write_u64(key_of(path));
+		write_u32((u32)dependencies.size());
+		for (auto& dependency : dependencies) {
+			write_u32((u32)dependency.path.size());
+			stream.write(dependency.path.data(), dependency.path.size());
+			write_u64(dependency.key);
+		}
+		if (!stream)
+			return;
+	}
+	remove(final_path.c_str());
+	rename(temporary_path.c_str(), final_path.c_str());
+}
+
+bool ModuleCache::read_entry(const std::string& path, Entry& entry) const {
+	std::ifstream stream(entry_path(path), std::ios::binary);
+	if (!stream)
+		return false;
+
+	auto read_u32 = [&]() { u32 value = 0; stream.read((char*)&value, sizeof(value)); return value; };
+	auto read_u64 = [&]() { u64 value = 0; stream.read((char*)&value, sizeof(value)); return value; };
+	if (read_u32() != ENTRY_MAGIC || read_u32() != VERSION)
+		return false;
+
+	entry.key = read_u64();
+	u32 dependency_count = read_u32();
+	for (u32 i = 0; stream && i < dependency_count; i++) {
+		Dependency dependency;
+		u32 path_length = read_u32();
+		if (path_length > MAX_PATH_LENGTH)
+			return false;
+		dependency.path.resize(path_length);
+		stream.read(&dependency.path[0], dependency.path.size());
+		dependency.key = read_u64();
+		entry.dependencies.push_back(dependency);
+	}
+	return (bool)stream;
+}
+
+std::string ModuleCache::entry_path(const std::string& path) const {
+	// Named after the module path so every module keeps exactly one entry however often it changes.
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.ipac", hash_bytes(FNV_OFFSET, path.data(), path.size()));
+	return m_folder + "/" + name;
+}
@@ -0,0 +1,59 @@
+#ifndef MODULE_CACHE_H
+#define MODULE_CACHE_H
+#include "common.h"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class Source;
+struct Settings;
+
+
+/* \brief Remembers on disk which modules compiled cleanly, so an unchanged module is not checked again.
+ * Only the fact that a module compiled is kept, not its AST or bytecode. A skipped module has neither, so
+ * the cache only serves builds that check modules for errors, not ones that print or run them.
+ * Every module gets a key hashed from its source text, the compiler version and the settings. An entry
+ * is only up to date while its key matches and every module it imported is up to date with the key
+ * it had back then, so a change to one file recompiles that module and everything that depends on it.
+ */
+class ModuleCache
+{
+public:
+	// Bump whenever the compiler changes what it accepts, older entries then simply stop matching.
+	static const u32 VERSION = 2;
+
+	struct Dependency {
+		std::string path;
+		u64 key;
+	};
+
+	ModuleCache(const std::string& folder, const Settings& settings);
+
+	// Hashes the source together with the version and settings, and remembers it as the key of its path.
+	u64 add(const Source* source);
+	u64 key_of(const std::string& path);
+
+	// True when path has an entry for its current key and all of its dependencies are up to date as well.
+	bool is_up_to_date(const std::string& path);
+	void store(const std::string& path, const std::vector<Dependency>& dependencies);
+
+private:
+	struct Entry {
+		u64 key;
+		std::vector<Dependency> dependencies;
+	};
+
+	bool read_entry(const std::string& path, Entry& entry) const;
+	std::string entry_path(const std::string& path) const;
+
+	std::string m_folder;
+	u64 m_settings_hash;
+
+	std::unordered_map<std::string, u64> m_keys;
+	// Paths currently being checked count as up to date, which lets import cycles terminate.
+	std::unordered_map<std::string, bool> m_up_to_date;
+};
+
+
+#endif // MODULE_CACHE_H
@@ -0,0 +1,101 @@
+#include "module_graph.h"
+#include "compiler.h"
+
+#include <algorithm>
+
+
+ModuleGraph::ModuleGraph(const std::vector<ModuleCompiler*>& module_compilers)
+	: m_nodes(module_compilers), m_edges(module_compilers.size()) {
+	std::unordered_map<Module*, i32> module_indices;
+	for (i32 i = 0; i < (i32)m_nodes.size(); i++) {
+		m_indices[m_nodes[i]] = i;
+		module_indices[m_nodes[i]->module()] = i;
+	}
+	for (i32 i = 0; i < (i32)m_nodes.size(); i++) {
+		for (auto module : m_nodes[i]->dependencies()) {
+			auto it = module_indices.find(module);
+			if (it != module_indices.end())
+				m_edges[i].push_back(it->second);
+		}
+	}
+}
+
+std::vector<ModuleCompiler*> ModuleGraph::find_cycle() const {
+	enum State : u8 { UNVISITED, ON_PATH, DONE };
+	std::vector<State> states(m_nodes.size(), UNVISITED);
+
+	// Depth first without recursion, import chains can be as long as the project is large.
+	struct Frame { i32 node; i32 next_edge; };
+	std::vector<Frame> path;
+	for (i32 root = 0; root < (i32)m_nodes.size(); root++) {
+		if (states[root] != UNVISITED)
+			continue;
+		path.push_back({ root, 0 });
+		states[root] = ON_PATH;
+
+		while (!path.empty()) {
+			Frame& frame = path.back();
+			if (frame.next_edge == (i32)m_edges[frame.node].size()) {
+				states[frame.node] = DONE;
+				path.pop_back();
+				continue;
+			}
+
+			i32 next = m_edges[frame.node][frame.next_edge++];
+			if (states[next] == UNVISITED) {
+				states[next] = ON_PATH;
+				path.push_back({ next, 0 });
+			} else if (states[next] == ON_PATH) {
+				std::vector<ModuleCompiler*> cycle;
+				auto start = std::find_if(path.begin(), path.end(), [&](const Frame& f) { return f.node == next; });
+				for (auto it = start; it != path.end(); ++it)
+					cycle.push_back(m_nodes[it->node]);
+				cycle.push_back(m_nodes[next]);
+				return cycle;
+			}
+		}
+	}
+	return {};
+}
+
+std::vector<std::vector<ModuleCompiler*>> ModuleGraph::waves(const std::vector<ModuleCompiler*>& pending) const {
+	// Kahn's algorithm, one wave is everything whose imports are all finished.
+	std::vector<i32> waiting_on(m_nodes.size(), 0);
+	std::vector<std::vector<i32>> dependents(m_nodes.size());
+	std::vector<bool> is_pending(m_nodes.size(), false);
+	for (auto module_compiler : pending)
+		is_pending[m_indices.at(module_compiler)] = true;
+
+	for (i32 i = 0; i < (i32)m_nodes.size(); i++) {
+		if (!is_pending[i])
+			continue;
+		for (i32 dependency : m_edges[i]) {
+			if (is_pending[dependency]) {
+				waiting_on[i]++;
+				dependents[dependency].push_back(i);
+			}
+		}
+	}
+
+	std::vector<std::vector<ModuleCompiler*>> result;
+	std::vector<i32> wave;
+	for (auto module_compiler : pending) {
+		if (waiting_on[m_indices.at(module_compiler)] == 0)
+			wave.push_back(m_indices.at(module_compiler));
+	}
+	while (!wave.empty()) {
+		std::vector<i32> next_wave;
+		result.emplace_back();
+		for (i32 node : wave) {
+			result.back().push_back(m_nodes[node]);
+			for (i32 dependent : dependents[node]) {
+				if (--waiting_on[dependent] == 0)
+					next_wave.push_back(dependent);
+			}
+		}
+		// Keep module order within a wave, it only matters for how errors are listed.
+		std::sort(next_wave.begin(), next_wave.end());
+		wave.swap(next_wave);
+	}
+	return result;
+}
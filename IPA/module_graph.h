@@ -0,0 +1,37 @@
+#ifndef MODULE_GRAPH_H
+#define MODULE_GRAPH_H
+#include "common.h"
+
+#include <unordered_map>
+#include <vector>
+
+class Module;
+class ModuleCompiler;
+
+
+/* \brief The import edges between the parsed modules of a compilation.
+ * Type inference of a module reads the inferred declarations of the modules it imports, so those
+ * have to be finished first. The graph finds import cycles, which can't be ordered like that, and
+ * splits the modules into waves where every module only depends on modules of earlier waves, the
+ * modules within one wave are inferred in parallel.
+ */
+class ModuleGraph
+{
+public:
+	explicit ModuleGraph(const std::vector<ModuleCompiler*>& module_compilers);
+
+	// Returns the modules of one import cycle with the first module repeated at the end, or an empty list.
+	std::vector<ModuleCompiler*> find_cycle() const;
+
+	// Orders pending into waves, modules outside of pending count as finished already.
+	std::vector<std::vector<ModuleCompiler*>> waves(const std::vector<ModuleCompiler*>& pending) const;
+
+private:
+	std::vector<ModuleCompiler*> m_nodes;
+	// Indices of the modules every node imports, imports of modules outside the graph are left out.
+	std::vector<std::vector<i32>> m_edges;
+	std::unordered_map<ModuleCompiler*, i32> m_indices;
+};
+
+
+#endif // MODULE_GRAPH_H
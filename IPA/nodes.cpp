@@ -12,11 +12,9 @@
 // Scope
 // =========================================================================================================
 
-static std::size_t scope_hash(const char* str, int count) {
-	std::size_t hash = 5381;
-	for (int i = 0; i < count; i++)
-		hash = ((hash << 5) + hash) + (int)str[i]; /* hash * 33 + c */
-	return hash;
+static std::size_t scope_hash(Symbol symbol) {
+	// Symbols are handed out in order, multiplying spreads neighbouring ones over the map.
+	return (std::size_t)(symbol * 2654435769u);
 }
 
 ast::Scope* ast::Scope::Create(CompilerAllocator* allocator, Scope* parent) {
@@ -31,10 +29,11 @@ ast::Scope* ast::Scope::Create(CompilerAllocator* allocator, Scope* parent) {
 
 ast::Decl* ast::Scope::get_decleration_or_null(const Token& name) {
 	assert(declerations_count != -1 && "Declerations have not been filled out in this scope. ");
-	if (declerations_map) {
-		auto index = scope_hash(name.first_char_ptr(), name.length()) % declerations_map_size;
+	// Names the compiler makes up have no symbol, they take the slow way through the list.
+	if (declerations_map && name.symbol() != NoSymbol) {
+		auto index = scope_hash(name.symbol()) % declerations_map_size;
 		while (declerations_map[index]) {
-			if (declerations_map[index]->name.equals(name))
+			if (declerations_map[index]->name.symbol() == name.symbol())
 				return declerations_map[index];
 			index = (index + 1) % declerations_map_size;
 		}
@@ -63,10 +62,11 @@ void ast::Scope::fill_out_declerations(CompilerAllocator* allocator, Decl** give
 		declerations_map_size = (i32)(count * 1.2f);
 		declerations_map = allocator->allocate_array<Decl*>(declerations_map_size);
 		memset(declerations_map, 0, sizeof(declerations_map[0]) * declerations_map_size);
-		for (i32 i = 0; i < declerations_map_size; i++) {
+		for (i32 i = 0; i < count; i++) {
 			auto& name_token = declerations[i]->name;
-			auto index = scope_hash(name_token.first_char_ptr(), name_token.length()) % declerations_map_size;
-			while (!declerations_map[index])
+			assert(name_token.symbol() != NoSymbol && "Declerations in a mapped scope need interned names. ");
+			auto index = scope_hash(name_token.symbol()) % declerations_map_size;
+			while (declerations_map[index])
 				index = (index + 1) % declerations_map_size;
 			declerations_map[index] = declerations[i];
 		}
@@ -162,17 +162,31 @@ ast::Variable* ast::Variable::Create(CompilerAllocator* allocator, Type* type, c
 // Struct
 // =========================================================================================================
 
-void ast::Struct::init(const Token& name) {
+void ast::Struct::init(CompilerAllocator* allocator, const Token& name) {
 	Decl::init(s_node_type, name, GLOBAL | CONST);
 	this->scope = nullptr;
+	this->type  = StructType::Create(allocator, this);
 }
 
 ast::Struct* ast::Struct::Create(CompilerAllocator* allocator, const Token& name) {
 	Struct* structure = allocator->allocate_one<Struct>();
-	structure->init(name);
+	structure->init(allocator, name);
 	return structure;
 }
 
+i32 ast::Struct::get_member_index_or_minus_one(Variable* member) {
+	i32 index = 0;
+	for (i32 i = 0; i < scope->declerations_count; i++) {
+		Variable* var = scope->declerations[i]->as_or_null<Variable>();
+		if (!var || (var->decl_flags & MEMBER) != MEMBER)
+			continue;
+		if (var == member)
+			return index;
+		++index;
+	}
+	return -1;
+}
+
 
 // =========================================================================================================
 // Function
@@ -186,6 +200,10 @@ void ast::Function::init(CompilerAllocator* allocator, const Token& name, Variab
 	this->arguments_count = arguments_count;
 	this->body            = nullptr;
 	this->next_overload   = nullptr;
+	this->intrinsic       = Intrinsic::NoIntrinsic;
+	this->owner           = nullptr;
+	this->lazy_body_token = -1;
+	this->code.store(nullptr, std::memory_order_relaxed);
 }
 
 ast::Function* ast::Function::Create(CompilerAllocator* allocator, const Token& name,
@@ -219,29 +237,30 @@ void ast::Expr::init(u32 node_type, Type* type) {
 // LoadExpr
 // =========================================================================================================
 
-void ast::LoadExpr::init(const Token& constant, Variable* variable, Expr* structure_expr) {
+void ast::LoadExpr::init(const Token& constant, Variable* variable, Expr* structure_expr, const Token& member_name) {
 	Expr::init(s_node_type, nullptr);
 	this->constant = constant;
+	this->member_name = member_name;
 	this->loaded_decl = variable;
 	this->structure_expr = structure_expr;
 }
 
 ast::LoadExpr* ast::LoadExpr::CreateLoadVariable(CompilerAllocator* allocator, Variable* variable) {
 	LoadExpr* expr = allocator->allocate_one<LoadExpr>();
-	expr->init(Token(), variable, nullptr);
+	expr->init(Token(), variable, nullptr, Token());
 	return expr;
 }
 
 ast::LoadExpr* ast::LoadExpr::CreateLoadConstant(CompilerAllocator* allocator, const Token& constant) {
 	LoadExpr* expr = allocator->allocate_one<LoadExpr>();
-	expr->init(constant, nullptr, nullptr);
+	expr->init(constant, nullptr, nullptr, Token());
 	return expr;
 
 }
 
-ast::LoadExpr* ast::LoadExpr::CreateLoadMember(CompilerAllocator* allocator, Expr* structure, Variable* member) {
+ast::LoadExpr* ast::LoadExpr::CreateLoadMember(CompilerAllocator* allocator, Expr* structure, const Token& member_name) {
 	LoadExpr* expr = allocator->allocate_one<LoadExpr>();
-	expr->init(Token(), member, structure);
+	expr->init(Token(), nullptr, structure, member_name);
 	return expr;
 }
 
@@ -276,6 +295,7 @@ void ast::ForStmt::init(Expr* array_expr, Expr* low_expr, Expr* high_expr, Block
 	this->it_var = nullptr;
 	this->index_var = nullptr;
 	this->block = block;
+	this->is_parallel = false;
 }
 
 ast::ForStmt* ast::ForStmt::Create(CompilerAllocator* allocator, Expr* array_expr, Block* block) {
@@ -344,16 +364,17 @@ ast::ExprStmt* ast::ExprStmt::Create(CompilerAllocator* allocator, Expr* expr) {
 // OperandExpr
 // =========================================================================================================
 
-void ast::OperandExpr::init(Operand operand, Expr* lhs, Expr* rhs) {
+void ast::OperandExpr::init(Operand operand, Expr* lhs, Expr* rhs, const Token& token) {
 	Expr::init(s_node_type, nullptr);
 	this->operand = operand;
 	this->lhs = lhs;
 	this->rhs = rhs;
+	this->token = token;
 }
 
-ast::OperandExpr* ast::OperandExpr::Create(CompilerAllocator* allocator, Operand operand, Expr* lhs, Expr* rhs) {
+ast::OperandExpr* ast::OperandExpr::Create(CompilerAllocator* allocator, Operand operand, Expr* lhs, Expr* rhs, const Token& token) {
 	OperandExpr* expr = allocator->allocate_one<OperandExpr>();
-	expr->init(operand, lhs, rhs);
+	expr->init(operand, lhs, rhs, token);
 	return expr;
 }
 
@@ -362,16 +383,17 @@ ast::OperandExpr* ast::OperandExpr::Create(CompilerAllocator* allocator, Operand
 // CallExpr
 // =========================================================================================================
 
-void ast::CallExpr::init(CompilerAllocator* allocator, Expr* callable, Expr** arguments, i32 arguments_count) {
+void ast::CallExpr::init(CompilerAllocator* allocator, Expr* callable, Expr** arguments, i32 arguments_count, const Token& token) {
 	Expr::init(s_node_type, nullptr);
 	this->callable = callable;
 	this->arguments = allocator->copy_array(arguments, arguments_count);
 	this->arguments_count = arguments_count;
+	this->token = token;
 }
 
-ast::CallExpr* ast::CallExpr::Create(CompilerAllocator* allocator, Expr* callable, Expr** arguments, i32 arguments_count) {
+ast::CallExpr* ast::CallExpr::Create(CompilerAllocator* allocator, Expr* callable, Expr** arguments, i32 arguments_count, const Token& token) {
 	CallExpr* expr = allocator->allocate_one<CallExpr>();
-	expr->init(allocator, callable, arguments, arguments_count);
+	expr->init(allocator, callable, arguments, arguments_count, token);
 	return expr;
 }
 
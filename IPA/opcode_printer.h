@@ -4,6 +4,16 @@
 
 #include <ostream>
 
+class ModuleCompiler;
+struct FunctionCode;
+namespace ast {
+	struct Function;
+}
+
+
+/* \brief Prints the bytecode of a module's functions, one instruction per line behind its offset.
+ * Printing compiles every function body of the module, like a first call to each of them would.
+ */
 class OpCodePrinter
 {
 public:
@@ -11,9 +21,14 @@ public:
 		: m_stream(stream)
 	{}
 
+	void print(ModuleCompiler* module);
+	void print(ast::Function* function, const FunctionCode& code);
+
+	static const char* OpCodeToString(OpCode opcode);
+
 private:
 	std::ostream& m_stream;
 };
 
 
-#endif // OPCODE_PRINTER_H
\ No newline at end of file
+#endif // OPCODE_PRINTER_H
@@ -11,20 +11,40 @@ enum class OpCode : u8
 {
 	OpNop,
 
+	// Operand is the u64 ast::Function* of the callee, zero when the callee was pushed before the arguments.
+	// The callee's code comes from FunctionCompiler::CodeFor, so a body is compiled on its first call.
 	OpCall,
+	OpTailCall,
 	OpJump8,
 	OpJump16,
 
+	// Counted loops, operands are a u8 local slot and an i16 jump relative to the next instruction.
+	// Prep pops high and low, stores them in slot and slot + 1 and jumps past the loop when low >= high.
+	// The loop opcode increments slot and jumps back to the body while slot < slot + 1.
+	OpForRangePrepI32, OpForRangePrepI64,
+	OpForRangeI32,     OpForRangeI64,
+	// Same operands, pops high and low and runs the body that follows once per index on the worker runtimes,
+	// each with its own copy of the frame. The jump skips the body, execution continues after it.
+	OpParallelForI32,  OpParallelForI64,
+
 	OpReturn,
 	OpReturnVoid,
 
 	OpPushConst32, OpPushConst64, OpPushRef, OpPushNull,
-	OpPop32, OpPop64,
+	OpPop,
+
+	// Operands are a u8 local slot that receives the ref and the u32 byte count, the memory is zeroed.
+	// Frame allocations are released when the frame returns.
+	OpHeapAlloc, OpFrameAlloc,
 
 	OpLoadGlobalS8,  OpLoadGlobalS16, OpLoadGlobalU8,  OpLoadGlobalU16,
 	OpLoadGlobalI32, OpLoadGlobalI64, OpLoadGlobalF32, OpLoadGlobalF64, OpLoadGlobalRef, 
 	OpLoadLocalS8,   OpLoadLocalS16,  OpLoadLocalU8,   OpLoadLocalU16,
 	OpLoadLocalI32,  OpLoadLocalI64,  OpLoadLocalF32,  OpLoadLocalF64,  OpLoadLocalRef,
+	// Vectors take two or four consecutive slots, see simd.h. Operand is the u8 first slot, loads push
+	// every slot of the vector and stores pop them again.
+	OpLoadLocalV128,  OpLoadLocalV256,
+	OpStoreLocalV128, OpStoreLocalV256,
 
 	OpLoadS8,  OpLoadS16, OpLoadU8, OpLoadU16, OpLoadI32, OpLoadI64,
 	OpLoadF32, OpLoadF64,
@@ -34,6 +54,7 @@ enum class OpCode : u8
 	OpArrayLoadS8,  OpArrayLoadS16,  OpArrayLoadI32,  OpArrayLoadI64,
 	OpArrayLoadU8,  OpArrayLoadU16,  OpArrayLoadF32,  OpArrayLoadF64,
 	OpArrayStoreI8, OpArrayStoreI16, OpArrayStoreI32, OpArrayStoreI64, OpArrayStoreF32, OpArrayStoreF64,
+	OpArrayColumn,
 
 	OpS64toS32, OpS32toS64,
 	OpU64toU32, OpU32toU64,
@@ -54,6 +75,64 @@ enum class OpCode : u8
 	OpLtS64, OpGtS64, OpLteS64, OpGteS64, OpLtU64, OpGtU64, OpLteU64, OpGteU64, OpEq64, OpNeq64,
 	OpLtF32, OpGtF32, OpLteF32, OpGteF32,
 	OpLtF64, OpGtF64, OpLteF64, OpGteF64,
+
+	OpAddF32x4, OpSubF32x4, OpMulF32x4, OpDivF32x4, OpLtF32x4, OpGtF32x4, OpEqF32x4,
+	OpAddF64x2, OpSubF64x2, OpMulF64x2, OpDivF64x2, OpLtF64x2, OpGtF64x2, OpEqF64x2,
+	OpAddS32x4, OpSubS32x4, OpMulS32x4, OpDivS32x4, OpLtS32x4, OpGtS32x4, OpEqS32x4,
+	OpAddF32x8, OpSubF32x8, OpMulF32x8, OpDivF32x8, OpLtF32x8, OpGtF32x8, OpEqF32x8,
+	OpAddF64x4, OpSubF64x4, OpMulF64x4, OpDivF64x4, OpLtF64x4, OpGtF64x4, OpEqF64x4,
+	OpAddS32x8, OpSubS32x8, OpMulS32x8, OpDivS32x8, OpLtS32x8, OpGtS32x8, OpEqS32x8,
+
+	OpReduceAddF32x4, OpReduceMinF32x4, OpReduceMaxF32x4,
+	OpReduceAddF64x2, OpReduceMinF64x2, OpReduceMaxF64x2,
+	OpReduceAddS32x4, OpReduceMinS32x4, OpReduceMaxS32x4,
+	OpReduceAddF32x8, OpReduceMinF32x8, OpReduceMaxF32x8,
+	OpReduceAddF64x4, OpReduceMinF64x4, OpReduceMaxF64x4,
+	OpReduceAddS32x8, OpReduceMinS32x8, OpReduceMaxS32x8,
+
+	OpShuffle32x4,
+
+	OpArraySumS32,   OpArraySumS64,   OpArraySumF32,   OpArraySumF64,
+	OpArrayMinS32,   OpArrayMinS64,   OpArrayMinF32,   OpArrayMinF64,
+	OpArrayMaxS32,   OpArrayMaxS64,   OpArrayMaxF32,   OpArrayMaxF64,
+	OpArrayDotS32,   OpArrayDotS64,   OpArrayDotF32,   OpArrayDotF64,
+	OpArrayAxpyS32,  OpArrayAxpyS64,  OpArrayAxpyF32,  OpArrayAxpyF64,
+	OpArrayScaleS32, OpArrayScaleS64, OpArrayScaleF32, OpArrayScaleF64,
+
+	// Operands are a u8 local slot that receives the channel, a u8 kind, 0 for MPMC and 1 for SPSC,
+	// and the u32 capacity. Send pops a value and the channel, recv pops the channel and pushes a value,
+	// both park the running fiber while the channel is full or empty.
+	OpChannelNew,
+	OpChannelSend, OpChannelRecv,
+	// Operand is the u8 local slot of a channel created by OpChannelNew, emitted on every way out of its frame.
+	OpChannelFree,
+
+	// OpGlobalRef pushes the address of the global whose ast::Variable* follows as a u64 operand,
+	// OpMemberRef pops a struct ref and pushes the address of the member with the u8 index.
+	OpGlobalRef, OpMemberRef,
+	// Sequentially consistent, they pop the operands and then the address. Add pushes the old value,
+	// compare exchange pops the expected and the desired value and pushes whether it stored.
+	OpAtomicLoadI32,  OpAtomicLoadI64,
+	OpAtomicStoreI32, OpAtomicStoreI64,
+	OpAtomicAddI32,   OpAtomicAddI64,
+	OpAtomicCasI32,   OpAtomicCasI64,
+
+	// Operand is the ast::Function* as u64. Range versions pop the low and high bound, which have the width
+	// of the function's argument, array versions pop the array, reduce pops the identity below either of them.
+	// Sum has a second u8 operand telling whether the results are s32, s64, f32 or f64.
+	OpParallelSumRange,    OpParallelSumArray,
+	OpParallelReduceRange, OpParallelReduceArray,
+
+	// Read and write pop the u8 array and the s32 descriptor and push the s64 byte count, close pops the
+	// descriptor and pushes an s32. Errors are pushed as negative errno values. A descriptor that is not
+	// ready parks the running fiber on its scheduler's event loop, the instruction is retried once it wakes.
+	OpIoRead, OpIoWrite, OpIoClose,
+
+	// Only found in recorded traces. Guards pop a condition and leave through the u16 exit when it differs
+	// from the recorded direction, OpTraceExit leaves unconditionally and OpTraceLoop restarts the trace.
+	OpGuardTrue, OpGuardFalse,
+	OpTraceExit,
+	OpTraceLoop,
 };
 
 
@@ -1,111 +1,227 @@
 #include "opcode_printer.h"
+#include "compiler.h"
 
 #include <assert.h>
 
-/*
-void OpCodePrinter::print(OpCodes code)
-{
-	if (!code.is_compiled())
-	{
-		m_stream << "<uncompiled>" << std::endl << std::endl;
-		return;
-	}
 
-	Function* function = code.function();
-	m_stream << function->name() << std::endl;
-	Op* op = code.start_operation();
+static const char* s_opcode_names[] = {
+	"Nop",
 
-	while (true)
-	{
-		switch (op->code())
-		{
-		case(OpEmptyCode):
-			m_stream << std::endl;
-			return;
+	"Call",
+	"TailCall",
+	"Jump8",
+	"Jump16",
 
-		case(OpIF):
-			m_stream << "if " << op->a() << std::endl;
-			break;
-		case(OpJUMP):
-			m_stream << "jmp " << op->sbx() << std::endl;
-			break;
+	"ForRangePrepI32", "ForRangePrepI64",
+	"ForRangeI32", "ForRangeI64",
 
-		case(OpCALLLocal):
-			m_stream << "call.local " << op->a() << " <- " << op->b() << std::endl;
-			break;
-		case(OpCALLStatic):
-			m_stream << "call.static " << op->bx() << std::endl;
-			break;
-		case(OpCALLVirtual):
-			m_stream << "call.virtual " << op->a() << "." << op->b() << std::endl;
-			break;
+	"ParallelForI32", "ParallelForI64",
 
-		case(Op32LOAD_CONSTANT):
-			m_stream << "loadc " << op->a() << " -> " << op->b() << std::endl;
-			break;
-		case(Op32LOAD_MEMBER):
-			m_stream << "loadm " << op->a() << "->" << op->b() << " -> " << op->c() << std::endl;
-			break;
-		case(Op32LOAD_STATIC):
-			m_stream << "loads " << op->bx() << " -> " << op->a() << std::endl;
-			break;
+	"Return",
+	"ReturnVoid",
 
-		case(Op32SET_LOCAL):
-			m_stream << "setl " << op->a() << " -> " << op->c() << std::endl;
-			break;
-		case(Op32SET_MEMBER):
-			m_stream << "setm " << op->a() << "->" << op->b() << " <- " << op->c() << std::endl;
-			break;
-		case(Op32SET_STATIC):
-			m_stream << "sets " << op->a() << " -> " << op->bx() << std::endl;
-			break;
+	"PushConst32", "PushConst64", "PushRef", "PushNull",
+	"Pop",
 
-		case(Op32RETURN):
-			m_stream << "return " << op->a() << std::endl;
-			break;
-		case(OpRETURN_VOID):
-			m_stream << "return" << std::endl;
-			break;
+	"HeapAlloc", "FrameAlloc",
 
-		case(OpI32ADD):
-			m_stream << "i32.add " << op->a() << " " << op->b() << " -> " << op->c() << std::endl;
-			break;
-		case(OpI32SUB):
-			m_stream << "i32.sub " << op->a() << " " << op->b() << " -> " << op->c() << std::endl;
-			break;
-		case(OpI32MUL):
-			m_stream << "i32.mul " << op->a() << " " << op->b() << " -> " << op->c() << std::endl;
-			break;
-		case(OpI32DIV):
-			m_stream << "i32.div " << op->a() << " " << op->b() << " -> " << op->c() << std::endl;
-			break;
-		case(OpI32MOD):
-			m_stream << "i32.mod " << op->a() << " " << op->b() << " -> " << op->c() << std::endl;
-			break;
+	"LoadGlobalS8", "LoadGlobalS16", "LoadGlobalU8", "LoadGlobalU16",
+	"LoadGlobalI32", "LoadGlobalI64", "LoadGlobalF32", "LoadGlobalF64", "LoadGlobalRef",
+	"LoadLocalS8", "LoadLocalS16", "LoadLocalU8", "LoadLocalU16",
+	"LoadLocalI32", "LoadLocalI64", "LoadLocalF32", "LoadLocalF64", "LoadLocalRef",
 
-		case(OpI32LT):
-			m_stream << "i32.lt " << op->a() << " " << op->b() << " -> " << op->c() << std::endl;
-			break;
-		case(OpI32LE):
-			m_stream << "i32.le " << op->a() << " " << op->b() << " -> " << op->c() << std::endl;
-			break;
+	"LoadLocalV128", "LoadLocalV256",
+	"StoreLocalV128", "StoreLocalV256",
 
-		case(OpI32GT):
-			m_stream << "i32.gt " << op->a() << " " << op->b() << " -> " << op->c() << std::endl;
-			break;
-		case(OpI32GE):
-			m_stream << "i32.ge " << op->a() << " " << op->b() << " -> " << op->c() << std::endl;
-			break;
+	"LoadS8", "LoadS16", "LoadU8", "LoadU16", "LoadI32", "LoadI64",
+	"LoadF32", "LoadF64",
+
+	"StoreI8", "StoreI16", "StoreI32", "StoreI64", "StoreF32", "StoreF64",
+
+	"ArrayLoadS8", "ArrayLoadS16", "ArrayLoadI32", "ArrayLoadI64",
+	"ArrayLoadU8", "ArrayLoadU16", "ArrayLoadF32", "ArrayLoadF64",
+	"ArrayStoreI8", "ArrayStoreI16", "ArrayStoreI32", "ArrayStoreI64", "ArrayStoreF32", "ArrayStoreF64",
+	"ArrayColumn",
+
+	"S64toS32", "S32toS64",
+	"U64toU32", "U32toU64",
+	"F64toF32", "F32toF64",
 
-		case(Op32NOT):
-			m_stream << "32.not " << op->a() << " -> " << op->c() << std::endl;
+	"AddI32", "SubI32",
+	"MulS32", "DivS32", "ModS32",
+	"MulU32", "DivU32", "ModU32",
+	"MulS64", "DivS64", "ModS64",
+	"MulU64", "DivU64", "ModU64",
+	"AddF32", "SubF32", "DivF32", "MulF32",
+	"AddF64", "SubF64", "DivF64", "MulF64",
+
+	"And32", "Or32", "Xor32", "Not32",
+	"And64", "Or64", "Xor64", "Not64",
+
+	"LtS32", "GtS32", "LteS32", "GteS32", "LtU32", "GtU32", "LteU32", "GteU32", "Eq32", "Neq32",
+	"LtS64", "GtS64", "LteS64", "GteS64", "LtU64", "GtU64", "LteU64", "GteU64", "Eq64", "Neq64",
+	"LtF32", "GtF32", "LteF32", "GteF32",
+	"LtF64", "GtF64", "LteF64", "GteF64",
+
+	"AddF32x4", "SubF32x4", "MulF32x4", "DivF32x4", "LtF32x4", "GtF32x4", "EqF32x4",
+	"AddF64x2", "SubF64x2", "MulF64x2", "DivF64x2", "LtF64x2", "GtF64x2", "EqF64x2",
+	"AddS32x4", "SubS32x4", "MulS32x4", "DivS32x4", "LtS32x4", "GtS32x4", "EqS32x4",
+	"AddF32x8", "SubF32x8", "MulF32x8", "DivF32x8", "LtF32x8", "GtF32x8", "EqF32x8",
+	"AddF64x4", "SubF64x4", "MulF64x4", "DivF64x4", "LtF64x4", "GtF64x4", "EqF64x4",
+	"AddS32x8", "SubS32x8", "MulS32x8", "DivS32x8", "LtS32x8", "GtS32x8", "EqS32x8",
+
+	"ReduceAddF32x4", "ReduceMinF32x4", "ReduceMaxF32x4",
+	"ReduceAddF64x2", "ReduceMinF64x2", "ReduceMaxF64x2",
+	"ReduceAddS32x4", "ReduceMinS32x4", "ReduceMaxS32x4",
+	"ReduceAddF32x8", "ReduceMinF32x8", "ReduceMaxF32x8",
+	"ReduceAddF64x4", "ReduceMinF64x4", "ReduceMaxF64x4",
+	"ReduceAddS32x8", "ReduceMinS32x8", "ReduceMaxS32x8",
+
+	"Shuffle32x4",
+
+	"ArraySumS32", "ArraySumS64", "ArraySumF32", "ArraySumF64",
+	"ArrayMinS32", "ArrayMinS64", "ArrayMinF32", "ArrayMinF64",
+	"ArrayMaxS32", "ArrayMaxS64", "ArrayMaxF32", "ArrayMaxF64",
+	"ArrayDotS32", "ArrayDotS64", "ArrayDotF32", "ArrayDotF64",
+	"ArrayAxpyS32", "ArrayAxpyS64", "ArrayAxpyF32", "ArrayAxpyF64",
+	"ArrayScaleS32", "ArrayScaleS64", "ArrayScaleF32", "ArrayScaleF64",
+
+	"ChannelNew",
+	"ChannelSend", "ChannelRecv",
+
+	"ChannelFree",
+
+	"GlobalRef", "MemberRef",
+
+	"AtomicLoadI32", "AtomicLoadI64",
+	"AtomicStoreI32", "AtomicStoreI64",
+	"AtomicAddI32", "AtomicAddI64",
+	"AtomicCasI32", "AtomicCasI64",
+
+	"ParallelSumRange", "ParallelSumArray",
+	"ParallelReduceRange", "ParallelReduceArray",
+
+	"IoRead", "IoWrite", "IoClose",
+
+	"GuardTrue", "GuardFalse",
+	"TraceExit",
+	"TraceLoop",
+};
+static_assert(sizeof(s_opcode_names) / sizeof(s_opcode_names[0]) == (size_t)OpCode::OpTraceLoop + 1, "Opcode names out of order");
+
+
+const char* OpCodePrinter::OpCodeToString(OpCode opcode) {
+	assert((size_t)opcode < sizeof(s_opcode_names) / sizeof(s_opcode_names[0]));
+	return s_opcode_names[(size_t)opcode];
+}
+
+void OpCodePrinter::print(ModuleCompiler* module) {
+	m_stream << "\nModule: " << module->source()->path() << "\n";
+	ast::Scope* scope = module->scope();
+	for (i32 i = 0; i < scope->declerations_count; i++) {
+		ast::Function* function = scope->declerations[i]->as_or_null<ast::Function>();
+		// Intrinsics and bodies that failed to parse have no code.
+		const FunctionCode* code = function ? FunctionCompiler::CodeFor(function) : nullptr;
+		if (code)
+			print(function, *code);
+	}
+}
+
+void OpCodePrinter::print(ast::Function* function, const FunctionCode& code) {
+	m_stream << function->name.to_str() << ": " << code.slot_count << " slots\n";
+
+	const u8* start = code.code.data();
+	const u8* end = start + code.code.size();
+	const u8* ip = start;
+	// Operands are little endian, an instruction cut short by the end of the code prints what is there.
+	auto read = [&](i32 size) {
+		u64 value = 0;
+		for (i32 i = 0; i < size && ip < end; i++)
+			value |= (u64)*ip++ << (i * 8);
+		return value;
+	};
+	auto print_function = [&]() {
+		ast::Function* callee = (ast::Function*)read(8);
+		m_stream << " " << (callee ? callee->name.to_str() : std::string("<pushed>"));
+	};
+	auto print_jump = [&](i32 size) {
+		i64 offset = size == 1 ? (i64)(i8)read(1) : (i64)(i16)read(2);
+		// Relative to the end of the instruction.
+		m_stream << " -> " << (ip - start) + offset;
+	};
+
+	while (ip < end) {
+		OpCode opcode = (OpCode)*ip;
+		m_stream << "    " << (ip - start) << "\t" << OpCodeToString(opcode);
+		++ip;
+
+		switch (opcode) {
+		case(OpCode::OpCall):
+		case(OpCode::OpTailCall):
+		case(OpCode::OpParallelReduceRange):
+		case(OpCode::OpParallelReduceArray):
+			print_function();
+			break;
+		case(OpCode::OpParallelSumRange):
+		case(OpCode::OpParallelSumArray):
+			print_function();
+			m_stream << " " << read(1);
+			break;
+		case(OpCode::OpJump8):
+			print_jump(1);
+			break;
+		case(OpCode::OpJump16):
+			print_jump(2);
+			break;
+		case(OpCode::OpForRangePrepI32): case(OpCode::OpForRangePrepI64):
+		case(OpCode::OpForRangeI32):     case(OpCode::OpForRangeI64):
+		case(OpCode::OpParallelForI32):  case(OpCode::OpParallelForI64):
+			m_stream << " " << read(1);
+			print_jump(2);
+			break;
+		case(OpCode::OpPushConst32):
+			m_stream << " " << read(4);
+			break;
+		case(OpCode::OpPushConst64):
+		case(OpCode::OpPushRef):
+			m_stream << " " << read(8);
+			break;
+		case(OpCode::OpHeapAlloc):
+		case(OpCode::OpFrameAlloc):
+			m_stream << " " << read(1);
+			m_stream << " " << read(4) << " bytes";
+			break;
+		case(OpCode::OpChannelNew):
+			m_stream << " " << read(1);
+			m_stream << (read(1) ? " spsc" : " mpmc");
+			m_stream << " " << read(4);
+			break;
+		case(OpCode::OpGlobalRef):
+		case(OpCode::OpLoadGlobalS8):  case(OpCode::OpLoadGlobalS16): case(OpCode::OpLoadGlobalU8):
+		case(OpCode::OpLoadGlobalU16): case(OpCode::OpLoadGlobalI32): case(OpCode::OpLoadGlobalI64):
+		case(OpCode::OpLoadGlobalF32): case(OpCode::OpLoadGlobalF64): case(OpCode::OpLoadGlobalRef): {
+			ast::Variable* variable = (ast::Variable*)read(8);
+			m_stream << " " << (variable ? variable->name.to_str() : std::string("<null>"));
+		} break;
+		case(OpCode::OpLoadLocalS8):   case(OpCode::OpLoadLocalS16):  case(OpCode::OpLoadLocalU8):
+		case(OpCode::OpLoadLocalU16):  case(OpCode::OpLoadLocalI32):  case(OpCode::OpLoadLocalI64):
+		case(OpCode::OpLoadLocalF32):  case(OpCode::OpLoadLocalF64):  case(OpCode::OpLoadLocalRef):
+		case(OpCode::OpLoadLocalV128): case(OpCode::OpLoadLocalV256):
+		case(OpCode::OpStoreLocalV128): case(OpCode::OpStoreLocalV256):
+		case(OpCode::OpChannelFree):
+		case(OpCode::OpArrayColumn):
+		case(OpCode::OpMemberRef):
+		case(OpCode::OpShuffle32x4):
+			m_stream << " " << read(1);
+			break;
+		case(OpCode::OpGuardTrue):
+		case(OpCode::OpGuardFalse):
+		case(OpCode::OpTraceExit):
+			m_stream << " " << read(2);
 			break;
 		default:
-			assert(false && "Unimplemented opcode printer. ");
+			break;
 		}
-
-		++op;
+		m_stream << "\n";
 	}
 }
-
-*/
@@ -6,13 +6,15 @@
 #include <iostream>
 
 
-Parser::Parser(ModuleCompiler* module_compiler)
-	: m_tokenizer(module_compiler), m_project(module_compiler->module()->project()), m_module_compiler(module_compiler) {
+Parser::Parser(ModuleCompiler* module_compiler, Tokenizer& tokenizer)
+	: m_tokenizer(tokenizer), m_project(module_compiler->module()->project()), m_module_compiler(module_compiler) {
 	m_allocator = module_compiler->allocator();
+	m_lazy_bodies = m_project->settings().lazy_bodies;
 }
 
 void Parser::parse() {
-	if (m_module_compiler->encountered_error())
+	// The tokens before a tokenizer error are still parsed, the errors in them are real.
+	if (m_module_compiler->encountered_error() && !m_tokenizer.encountered_error())
 		return;
 
 	m_ctx.scope = m_module_compiler->scope();
@@ -36,6 +38,19 @@ void Parser::parse() {
 	m_module_compiler->scope()->fill_out_declerations(m_allocator, &m_declerations_stack[0], (i32)m_declerations_stack.size());
 }
 
+void Parser::parse_lazy_body(ast::Function* function) {
+	assert(function->lazy_body_token >= 0);
+	m_tokenizer.seek(function->lazy_body_token);
+	function->lazy_body_token = -1;
+
+	m_ctx.scope = m_module_compiler->scope();
+	Context ctx = update_context(function);
+	for (i32 i = 0; i < function->arguments_count; i++)
+		add_local_variables_or_return_false(function->arguments[i]);
+	function->body = parse_block();
+	restore_context(ctx);
+}
+
 void Parser::parse_imports() {
 	bool is_import = optional(Keyword::ImportKeyword);
 	if (!is_import) required(Keyword::FromKeyword);
@@ -45,14 +60,25 @@ void Parser::parse_imports() {
 	std::string path;
 
 	Token error_token;
+	Token first_identifier;
 	do {
 		Token identifier = optional(TokenType::IdentifierToken);
 		if (!identifier) error_token = m_tokenizer.peek();
+		if (first_iteration) first_identifier = identifier;
 		if (!first_iteration) path += '/';
 		path += identifier.to_str();
 		first_iteration = false;
-	} while (optional(Operand::DotOperand) || error_token);
-	Module* module = m_module_compiler->compiler()->resolve_module(path);
+	} while (!error_token && optional(Operand::DotOperand));
+	Module* module = nullptr;
+	if (!error_token) {
+		module = m_module_compiler->compiler()->resolve_module(path, is_relative ? m_module_compiler->module() : nullptr);
+		if (!module) {
+			raise_error_and_continue_after_line()
+				->message("Can't find module '")->message(path)->message("' in the source folders: ")
+				->highlight_token(first_identifier);
+			return;
+		}
+	}
 
 	if (is_import) {
 		do {
@@ -109,14 +135,21 @@ void Parser::parse_imports() {
 	return;
 }
 
-void Parser::parse_decleration() {
-	std::vector<Token> attributes;
-	std::vector<bool> used_attributes;
+void Parser::parse_attributes(std::vector<Token>& attributes) {
+	while (optional(Operand::AtOperand)) {
+		attributes.push_back(required(TokenType::IdentifierToken));
+		optional(TokenType::StmtEndToken);
+	}
+}
 
-	auto has_attribute = [&](const char* attr) -> Token {
-		Token attr_token(TokenType::ErrorToken, attr, (i32)strlen(attr), -1);
+void Parser::parse_decleration(const std::vector<Token>& leading_attributes) {
+	std::vector<Token> attributes = leading_attributes;
+	parse_attributes(attributes);
+	std::vector<bool> used_attributes(attributes.size(), false);
+
+	auto has_attribute = [&](Symbol attr) -> Token {
 		for (i32 i = 0; i < attributes.size(); i++) {
-			if (attributes[i].equals(attr_token)) {
+			if (attributes[i].symbol() == attr) {
 				used_attributes[i] = true;
 				return attributes[i];
 			}
@@ -124,12 +157,6 @@ void Parser::parse_decleration() {
 		return Token();
 	};
 
-	while (optional(Operand::AtOperand)) {
-		attributes.push_back(required(TokenType::IdentifierToken));
-		used_attributes.push_back(false);
-		optional(TokenType::StmtEndToken);
-	}
-
 	Token name = required(TokenType::IdentifierToken);
 	if (!name) 
 		return;
@@ -149,7 +176,7 @@ void Parser::parse_decleration() {
 
 	if (is_constant)
 		flags |= ast::Decl::CONST;
-	if (!has_attribute("global")) {
+	if (!has_attribute(GlobalSymbol)) {
 		if (m_ctx.decl && m_ctx.decl->as_or_null<ast::Function>()) {
 			flags |= ast::Decl::LOCAL;
 		} else if (m_ctx.decl && m_ctx.decl->as_or_null<ast::Struct>()) {
@@ -161,7 +188,17 @@ void Parser::parse_decleration() {
 		flags |= ast::Decl::GLOBAL;
 	}
 
-	if (Token token = has_attribute("export")) {
+	if (Token token = has_attribute(SpscSymbol)) {
+		if (!type || !type->is_channel()) {
+			raise_error_and_continue()
+				->message("The 'spsc' attribute can only be used on variables declared with a channel type. ")
+				->highlight_token(token);
+		} else {
+			flags |= ast::Decl::SPSC;
+		}
+	}
+
+	if (Token token = has_attribute(ExportSymbol)) {
 		if (m_ctx.decl) {
 			raise_error_and_continue()
 				->message("The 'export' attribute can only be used in file scope. ")
@@ -180,6 +217,8 @@ void Parser::parse_decleration() {
 
 			ast::Struct* structure = ast::Struct::Create(m_allocator, name);
 			structure->scope = ast::Scope::Create(m_allocator, m_ctx.scope);
+			if (has_attribute(SoaSymbol))
+				structure->decl_flags |= ast::Decl::SOA;
 			Context ctx = update_context(structure);
 
 			if (optional(Keyword::PassKeyword)) {
@@ -220,12 +259,19 @@ void Parser::parse_decleration() {
 			}
 
 			ast::Function* function = ast::Function::Create(m_allocator, name, &arguments[0], (i32)arguments.size(), return_type);
+			function->owner = m_module_compiler;
 			Context ctx = update_context(function);
 
 			for (auto arg : arguments)
 				add_local_variables_or_return_false(arg);
 
-			function->body = parse_block();
+			// Only bodies in file scope are skipped, nested ones are parsed along with their parent.
+			if (m_lazy_bodies && !ctx.decl) {
+				function->lazy_body_token = m_tokenizer.position();
+				skip_block();
+			} else {
+				function->body = parse_block();
+			}
 
 			restore_context(ctx);
 			decl = function;
@@ -237,7 +283,7 @@ void Parser::parse_decleration() {
 
 			if ((flags & ast::Variable::LOCAL) == ast::Variable::LOCAL) {
 				ast::LoadExpr* var_expr = ast::LoadExpr::CreateLoadVariable(m_allocator, var);
-				ast::OperandExpr* assign_expr = ast::OperandExpr::Create(m_allocator, Operand::SetOperand, var_expr, expr);
+				ast::OperandExpr* assign_expr = ast::OperandExpr::Create(m_allocator, Operand::SetOperand, var_expr, expr, name);
 				ast::ExprStmt* stmt = ast::ExprStmt::Create(m_allocator, assign_expr);
 				m_statements_stack.push_back(stmt);
 			}
@@ -270,13 +316,67 @@ ast::Type* Parser::parse_type() {
 	Token primitive = optional(TokenType::PrimitiveToken);
 	if (primitive) {
 		return ast::Type::GetPrimitiveOrAssert(primitive.primitive());
+	} else if (optional(Operand::LSquareBracketOperand)) {
+		if (!required(Operand::RSquareBracketOperand))
+			return nullptr;
+		ast::Type* element_type = parse_type();
+		if (element_type)
+			result = ast::ArrayType::Create(m_allocator, element_type);
+	} else if (Token name = optional(TokenType::IdentifierToken)) {
+		if (name.symbol() == ChannelSymbol && optional(Operand::LSquareBracketOperand))
+			return parse_channel_type();
+		ast::UnresolvedType* type = ast::UnresolvedType::Create(m_allocator, name);
+		m_module_compiler->add_link(type, m_ctx.scope);
+		result = type;
 	} else {
-		assert(false);
+		Token token = m_tokenizer.peek();
+		raise_error_and_stop()
+			->message("Expected a type, got ")->message(Token::TokenTypeToString(token.type()))->message(", error token detected here: ")
+			->highlight_token(token);
 	}
 
 	return result;
 }
 
+ast::Type* Parser::parse_channel_type() {
+	ast::Type* element_type = parse_type();
+	if (!element_type)
+		return nullptr;
+
+	u32 capacity = ast::ChannelType::DEFAULT_CAPACITY;
+	if (optional(Operand::CommaOperand)) {
+		Token number = required(TokenType::NumberToken);
+		if (!number)
+			return nullptr;
+		std::string digits = number.to_str();
+		if (digits.find_first_not_of("0123456789") != std::string::npos || digits.length() > 9 || std::stoul(digits) == 0) {
+			raise_error_and_continue()
+				->message("The capacity of a channel has to be a positive integer: ")
+				->highlight_token(number);
+		} else {
+			capacity = (u32)std::stoul(digits);
+		}
+	}
+
+	if (!required(Operand::RSquareBracketOperand))
+		return nullptr;
+	return ast::ChannelType::Create(m_allocator, element_type, capacity);
+}
+
+void Parser::skip_block() {
+	if (!required(Operand::ColonOperand) || !required(TokenType::StmtEndToken) || !required(TokenType::ScopeBegToken))
+		return;
+	for (i32 depth = 1; depth > 0; ) {
+		Token token = m_tokenizer.eat();
+		if (token.is(TokenType::ScopeBegToken))
+			++depth;
+		else if (token.is(TokenType::ScopeEndToken))
+			--depth;
+		else if (token.is(TokenType::EOFToken))
+			break;
+	}
+}
+
 ast::Block* Parser::parse_block() {
 	ast::Scope* scope = ast::Scope::Create(m_allocator, m_ctx.scope);
 	Context old_ctx = update_context(scope);
@@ -297,8 +397,15 @@ ast::Block* Parser::parse_block() {
 				parse_while_stmt();
 			else if (token.is(Keyword::ForKeyword))
 				parse_for_stmt();
-			else if ((token.is(TokenType::IdentifierToken) && m_tokenizer.peek(1).is(Operand::ColonOperand)) ||
-				token.is(Operand::AtOperand)) {
+			else if (token.is(Operand::AtOperand)) {
+				// Attributes can belong to a decleration or to a statement.
+				std::vector<Token> attributes;
+				parse_attributes(attributes);
+				if (m_tokenizer.peek().is(Keyword::ForKeyword))
+					parse_for_stmt(attributes);
+				else
+					parse_decleration(attributes);
+			} else if (token.is(TokenType::IdentifierToken) && m_tokenizer.peek(1).is(Operand::ColonOperand)) {
 				parse_decleration();
 			} else if (token.is(TokenType::ScopeEndToken))
 				break;
@@ -352,7 +459,18 @@ void Parser::parse_if_stmt(bool is_elif) {
 	m_statements_stack.push_back(stmt);
 }
 
-void Parser::parse_for_stmt() {
+void Parser::parse_for_stmt(const std::vector<Token>& attributes) {
+	bool is_parallel = false;
+	for (const Token& attribute : attributes) {
+		if (attribute.symbol() == ParallelSymbol) {
+			is_parallel = true;
+		} else {
+			raise_error_and_continue()
+				->message("Unrecognised attribute. ")
+				->highlight_token(attribute);
+		}
+	}
+
 	required(Keyword::ForKeyword);
 	
 	ast::Expr* first_expr = parse_expr();
@@ -361,17 +479,40 @@ void Parser::parse_for_stmt() {
 		upper_expr = parse_expr();
 	}
 
+	Token it_name, index_name;
 	if (optional(Keyword::AsKeyword)) {
-		Token it_name = required(TokenType::IdentifierToken);
+		it_name = required(TokenType::IdentifierToken);
 		if (optional(Operand::CommaOperand))
-			Token index_name = required(TokenType::IdentifierToken);
+			index_name = required(TokenType::IdentifierToken);
+	}
+	if (upper_expr && index_name) {
+		raise_error_and_continue()
+			->message("A range loop only has one loop variable, the value is its own index. ")
+			->highlight_token(index_name);
+	}
+
+	// The loop variables are only visible inside the body, their types come from the type inferer.
+	i32 local_variables_count = (i32)m_local_variables_stack.size();
+	ast::Variable* it_var = nullptr;
+	ast::Variable* index_var = nullptr;
+	if (it_name) {
+		it_var = ast::Variable::Create(m_allocator, nullptr, it_name, nullptr, ast::Decl::LOCAL);
+		add_local_variables_or_return_false(it_var);
+	}
+	if (index_name && !upper_expr) {
+		index_var = ast::Variable::Create(m_allocator, nullptr, index_name, nullptr, ast::Decl::LOCAL);
+		add_local_variables_or_return_false(index_var);
 	}
 
 	ast::Block* block = parse_block();
+	m_local_variables_stack.resize(local_variables_count);
 
 	ast::ForStmt* stmt = upper_expr ? 
 		ast::ForStmt::Create(m_allocator, first_expr, upper_expr, block) :
 		ast::ForStmt::Create(m_allocator, first_expr, block);
+	stmt->it_var = it_var;
+	stmt->index_var = index_var;
+	stmt->is_parallel = is_parallel;
 	m_statements_stack.push_back(stmt);
 }
 
@@ -433,10 +574,10 @@ ast::Expr* Parser::parse_expr(int* precedens_lvl_out) {
 		precedens_level = 11; goto valid_operand;
 
 	valid_operand:
-		m_tokenizer.eat();
+		Token operand_token = m_tokenizer.eat();
 		int rhs_precedens_level;
 		ast::Expr* rhs = parse_expr(&rhs_precedens_level);
-		ast::OperandExpr* this_operand = ast::OperandExpr::Create(m_allocator, operand, expr, rhs);
+		ast::OperandExpr* this_operand = ast::OperandExpr::Create(m_allocator, operand, expr, rhs, operand_token);
 		if (precedens_level < rhs_precedens_level) {
 			ast::OperandExpr* rhs_operand = rhs->as_or_assert<ast::OperandExpr>();
 			ast::Expr* temp = rhs_operand->lhs;
@@ -470,7 +611,7 @@ ast::Expr* Parser::parse_unary_prefix_operators() {
 			Token operand = m_tokenizer.eat();
 			ast::Expr* value = parse_unary_prefix_operators();
 			if (!value) return nullptr;
-			expr = ast::OperandExpr::Create(m_allocator, operand.operand(), nullptr, value);
+			expr = ast::OperandExpr::Create(m_allocator, operand.operand(), nullptr, value, operand);
 		} break;
 		default:
 			if (token.is(TokenType::IdentifierToken)) {
@@ -503,23 +644,24 @@ ast::Expr* Parser::parse_unary_prefix_operators() {
 ast::Expr* Parser::parse_unary_postfix_operators(ast::Expr* expr) {
 	Token token = m_tokenizer.peek();
 	if (token.is(Operand::IncrementOperand) || token.is(Operand::DecrementOperand)) {
-		expr = ast::OperandExpr::Create(m_allocator, m_tokenizer.eat().operand(), expr, nullptr);
+		Token operand = m_tokenizer.eat();
+		expr = ast::OperandExpr::Create(m_allocator, operand.operand(), expr, nullptr, operand);
 		expr = parse_unary_postfix_operators(expr);
 	} else if (token.is(Operand::DotOperand)) {
 		m_tokenizer.eat();
 		Token member_name = required(TokenType::IdentifierToken);
-		expr = ast::LoadExpr::CreateLoadMember(m_allocator, expr, nullptr);
+		expr = ast::LoadExpr::CreateLoadMember(m_allocator, expr, member_name);
 		expr = parse_unary_postfix_operators(expr);
 	} else if (token.is(Operand::LPharenthesesOperand)) {
 		std::vector<ast::Expr*> arguments;
-		required(Operand::LPharenthesesOperand);
+		Token parenthesis = required(Operand::LPharenthesesOperand);
 		if (!optional(Operand::RPharenthesesOperand)) {
 			do {
 				arguments.push_back(parse_expr());
 			} while (optional(Operand::CommaOperand));
 			required(Operand::RPharenthesesOperand);
 		}
-		expr = ast::CallExpr::Create(m_allocator, expr, &arguments[0], (i32)arguments.size());
+		expr = ast::CallExpr::Create(m_allocator, expr, &arguments[0], (i32)arguments.size(), parenthesis);
 		expr = parse_unary_postfix_operators(expr);
 	} else if (token.is(Operand::LSquareBracketOperand)) {
 		required(Operand::LSquareBracketOperand);
@@ -624,13 +766,24 @@ Token Parser::optional(Operand data) {
 	return m_tokenizer.peek().operand() == data ? m_tokenizer.eat() : Token();
 }
 
-CompilerError* Parser::raise_error_and_continue() {
+CompilerError* Parser::raise_error() {
+	// After failing the tokenizer makes up the end of the file. The tokenizer reported the real problem, errors
+	// about the made up tokens are left out. Errors about the tokens before the failure are real, tokenizers
+	// that keep their tokens fail before parsing even starts.
+	if (m_tokenizer.reached_error()) {
+		m_should_stop = true;
+		return CompilerError::Create(m_allocator, m_module_compiler->module());
+	}
 	return m_module_compiler->raise_error();
 }
 
+CompilerError* Parser::raise_error_and_continue() {
+	return raise_error();
+}
+
 CompilerError* Parser::raise_error_and_stop() {
 	m_should_stop = true;
-	return m_module_compiler->raise_error();
+	return raise_error();
 }
 
 CompilerError* Parser::raise_error_and_continue_after_line() {
@@ -640,7 +793,7 @@ CompilerError* Parser::raise_error_and_continue_after_line() {
 		token = m_tokenizer.peek();
 	}
 	if (token.is(TokenType::StmtEndToken)) m_tokenizer.eat();
-	return m_module_compiler->raise_error();
+	return raise_error();
 }
 
 void Parser::required_stmt_end_or_raise_garbage_error_and_continue_after_line() {
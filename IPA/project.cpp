@@ -7,8 +7,36 @@
 
 Project::Project(int argc, char* argv[]) {
 	for (int i = 1; i < argc; i++) {
-		m_settings.source_files.push_back(argv[i]);
+		std::string argument = argv[i];
+		if (argument.compare(0, 2, "--") != 0) {
+			m_settings.source_files.push_back(argument);
+			continue;
+		}
+
+		if (argument == "--no-print-tokens")
+			m_settings.print_tokens = false;
+		else if (argument == "--no-print-ast")
+			m_settings.print_ast = false;
+		else if (argument == "--print-opcodes")
+			m_settings.print_opcodes = true;
+		else if (argument == "--no-cache")
+			m_settings.use_cache = false;
+		else if (argument.compare(0, 8, "--cache=") == 0)
+			m_settings.cache_folder = argument.substr(8);
+		else if (argument == "--lazy-bodies")
+			m_settings.lazy_bodies = true;
+		else if (argument == "--watch")
+			m_settings.watch = true;
+		else if (argument.compare(0, 9, "--socket=") == 0)
+			m_settings.socket_path = argument.substr(9);
+		else if (argument.compare(0, 16, "--source-folder=") == 0)
+			m_settings.source_folders.push_back(argument.substr(16));
+		else
+			std::cerr << "Ignoring unknown option " << argument << std::endl;
 	}
+	// Imports are looked up relative to the working directory unless told otherwise.
+	if (m_settings.source_folders.empty())
+		m_settings.source_folders.push_back(".");
 
 
 	for (auto path : m_settings.source_files) {
@@ -31,6 +59,11 @@ Module* Project::get_or_create_module(const std::string& name) {
 	return result;
 }
 
+Module* Project::get_module(const std::string& path) const {
+	auto it = m_modules.find(path);
+	return it == m_modules.end() ? nullptr : it->second;
+}
+
 
 
 // =========================================================================================================
@@ -1,6 +1,8 @@
 #ifndef PROJECT_H
 #define PROJECT_H
 
+#include "symbol_table.h"
+
 #include <queue>
 #include <string>
 #include <map>
@@ -17,6 +19,19 @@ struct Settings {
 	bool print_tokens = true;
 	bool print_ast    = true;
 	bool print_opcodes = false;
+
+	// Modules that compiled cleanly are remembered here and skipped until they or their imports change.
+	// The cache is only consulted when nothing about the modules themselves has to be printed.
+	bool use_cache = true;
+
+	// Function bodies are only skipped over at first and parsed, checked and compiled on their first call.
+	// Errors inside a body that is never called are not reported.
+	bool lazy_bodies = false;
+	std::string cache_folder = ".ipa_cache";
+
+	// Stay resident after the first compile, recompiling on every save and answering on socket_path.
+	bool watch = false;
+	std::string socket_path = ".ipa_socket";
 };
 
 
@@ -37,6 +52,7 @@ public:
 	modules_iterator modules_end()   const { return m_modules.end();   }
 
 	const Settings& settings() const { return m_settings; }
+	SymbolTable& symbols() { return m_symbols; }
 
 private:
 
@@ -45,6 +61,7 @@ private:
 	std::map<std::string, Module*> m_modules;
 
 	Settings m_settings;
+	SymbolTable m_symbols;
 
 	Scope* m_global_scope;
 };
@@ -1,9 +1,121 @@
 #include "runtime.h"
 #include "compiler.h"
+#include "fiber.h"
 
 #include <assert.h>
 
 
+FrameArena::FrameArena(i64 first_chunk_size) {
+	m_current_chunk = allocate_chunk(first_chunk_size);
+}
+
+FrameArena::~FrameArena() {
+	Chunk* chunk = m_current_chunk;
+	while (chunk->m_next != nullptr) chunk = chunk->m_next;
+	while (chunk) {
+		char* memory = (char*)chunk;
+		chunk = chunk->m_prev;
+		delete[] memory;
+	}
+}
+
+void FrameArena::reset(const Mark& mark) {
+	// Chunks after the marked one stay linked for the next frames to reuse.
+	for (Chunk* chunk = mark.chunk->m_next; chunk && chunk->m_used != 0; chunk = chunk->m_next)
+		chunk->m_used = 0;
+	m_current_chunk = mark.chunk;
+	m_current_chunk->m_used = mark.used;
+}
+
+void* FrameArena::allocate(i64 byte_count) {
+	i64 offset = (m_current_chunk->m_used + 7) & ~(i64)7;
+	while (offset + byte_count > m_current_chunk->m_size) {
+		Chunk* next = m_current_chunk->m_next;
+		if (!next || next->m_size < byte_count) {
+			i64 new_chunk_size = 64 * 1024;
+			if (new_chunk_size < byte_count) new_chunk_size = byte_count;
+			Chunk* new_chunk = allocate_chunk(new_chunk_size);
+
+			new_chunk->m_prev = m_current_chunk;
+			new_chunk->m_next = next;
+			if (next) next->m_prev = new_chunk;
+			m_current_chunk->m_next = new_chunk;
+			next = new_chunk;
+		}
+		m_current_chunk = next;
+		offset = 0;
+	}
+	m_current_chunk->m_used = offset + byte_count;
+	void* result = &m_current_chunk->m_data[offset];
+	memset(result, 0, byte_count);
+	return result;
+}
+
+FrameArena::Chunk* FrameArena::allocate_chunk(i64 size) {
+	char* memory = new char[size + offsetof(Chunk, m_data)];
+	Chunk* chunk = (Chunk*)memory;
+	chunk->m_used = 0;
+	chunk->m_size = size;
+	chunk->m_next = nullptr;
+	chunk->m_prev = nullptr;
+	return chunk;
+}
+
+
+void Runtime::set_running_fiber(Fiber* fiber) {
+	m_running_fiber = fiber;
+	m_active_frame_arena = fiber ? &fiber->frame_arena : &m_frame_arena;
+}
+
+Runtime* Runtime::ensure_thread_pool() {
+	// Parallel loops nested in the body of another run on the pool of the top-level runtime, which then
+	// runs them serially on the participant that reached them.
+	if (m_owner)
+		return m_owner->ensure_thread_pool();
+	if (m_thread_pool)
+		return this;
+	m_thread_pool = new ThreadPool();
+	for (i32 i = 0; i < m_thread_pool->participant_count(); i++) {
+		Runtime* worker = new Runtime(m_project);
+		worker->m_owner = this;
+		m_worker_runtimes.push_back(worker);
+	}
+	return this;
+}
+
+void Runtime::parallel_for(i64 low, i64 high, const std::function<void(Runtime& worker, i64 begin, i64 end)>& body) {
+	Runtime* owner = ensure_thread_pool();
+	owner->m_thread_pool->parallel_for(low, high, [&](i64 begin, i64 end, i32 participant_index) {
+		body(*owner->m_worker_runtimes[participant_index], begin, end);
+	});
+}
+
+Slot Runtime::parallel_reduce(i64 low, i64 high, Slot identity, const FoldChunk& fold, const Combine& combine) {
+	Runtime* owner = ensure_thread_pool();
+
+	// Participants write their partial on every chunk, keep each on its own cache line.
+	struct alignas(64) Partial {
+		Slot value;
+	};
+	i32 participant_count = owner->m_thread_pool->participant_count();
+	std::vector<Partial> partials(participant_count);
+	for (auto& partial : partials)
+		partial.value = identity;
+
+	owner->m_thread_pool->parallel_for(low, high, [&](i64 begin, i64 end, i32 participant_index) {
+		Partial& partial = partials[participant_index];
+		partial.value = fold(*owner->m_worker_runtimes[participant_index], begin, end, partial.value);
+	});
+
+	// There is one partial per participant, few enough to combine on the calling thread.
+	for (i32 stride = 1; stride < participant_count; stride *= 2) {
+		for (i32 i = 0; i + stride < participant_count; i += stride * 2)
+			partials[i].value = combine(*this, partials[i].value, partials[i + stride].value);
+	}
+	return partials[0].value;
+}
+
+
 void Runtime::initialize()
 {
 	
@@ -22,7 +134,7 @@ Runtime& Runtime::arg(u8 value) {
 	assert(m_call && m_current_argument_index != m_call->arguments_count && "To many arguments given. ");
 	// assert(m_call->arguments[m_current_argument_index]->type == ast::Type::U8() && "Argument is off wrong type. ");
 
-	*m_stack_ptr++ = value;
+	(m_stack_ptr++)->as_u32 = value;
 	++m_current_argument_index;
 
 	return *this;
@@ -33,7 +145,7 @@ Runtime& Runtime::arg(i8 value) {
 	assert(m_call && m_current_argument_index != m_call->arguments_count && "To many arguments given. ");
 	// assert(m_call->arguments[m_current_argument_index]->type == ast::Type::S8() && "Argument is off wrong type. ");
 
-	*m_stack_ptr = value;
+	(m_stack_ptr++)->as_i32 = value;
 	++m_current_argument_index;
 
 	return *this;
@@ -45,7 +157,7 @@ Runtime& Runtime::arg(u16 value)
 	assert(m_call && m_current_argument_index != m_call->arguments_count && "To many arguments given. ");
 	// assert(m_call->arguments[m_current_argument_index]->type == ast::Type::U16() && "Argument is off wrong type. ");
 
-	*m_stack_ptr++ = value;
+	(m_stack_ptr++)->as_u32 = value;
 	++m_current_argument_index;
 
 	return *this;
@@ -57,7 +169,7 @@ Runtime& Runtime::arg(i16 value)
 	assert(m_call && m_current_argument_index != m_call->arguments_count && "To many arguments given. ");
 	// assert(m_call->arguments[m_current_argument_index]->type == ast::Type::S16() && "Argument is off wrong type. ");
 
-	*m_stack_ptr++ = value;
+	(m_stack_ptr++)->as_i32 = value;
 	++m_current_argument_index;
 
 	return *this;
@@ -69,7 +181,7 @@ Runtime& Runtime::arg(u32 value)
 	assert(m_call && m_current_argument_index != m_call->arguments_count && "To many arguments given. ");
 	// assert(m_call->arguments[m_current_argument_index]->type == ast::Type::U32() && "Argument is off wrong type. ");
 
-	*m_stack_ptr++ = value;
+	(m_stack_ptr++)->as_u32 = value;
 	++m_current_argument_index;
 
 	return *this;
@@ -81,7 +193,7 @@ Runtime& Runtime::arg(i32 value)
 	assert(m_call && m_current_argument_index != m_call->arguments_count && "To many arguments given. ");
 	// assert(m_call->arguments[m_current_argument_index]->type == ast::Type::S32() && "Argument is off wrong type. ");
 
-	*m_stack_ptr++ = value;
+	(m_stack_ptr++)->as_i32 = value;
 	++m_current_argument_index;
 
 	return *this;
@@ -93,9 +205,7 @@ Runtime& Runtime::arg(u64 value)
 	assert(m_call && m_current_argument_index != m_call->arguments_count && "To many arguments given. ");
 	// assert(m_call->arguments[m_current_argument_index]->type == ast::Type::U64() && "Argument is off wrong type. ");
 
-	m_stack_ptr = (i32*)(((uintptr_t)m_stack_ptr + (alignof(u64) - 1)) & (alignof(u64) - 1));
-	*((u64*)m_stack_ptr) = value;
-	m_stack_ptr += 2;
+	(m_stack_ptr++)->as_u64 = value;
 	++m_current_argument_index;
 
 	return *this;
@@ -107,9 +217,7 @@ Runtime& Runtime::arg(i64 value)
 	assert(m_call && m_current_argument_index != m_call->arguments_count && "To many arguments given. ");
 	// assert(m_call->arguments[m_current_argument_index]->type == ast::Type::S64() && "Argument is off wrong type. ");
 
-	m_stack_ptr = (i32*)(((uintptr_t)m_stack_ptr + (alignof(u64) - 1)) & (alignof(u64) - 1));
-	*((i64*)m_stack_ptr) = value;
-	m_stack_ptr += 2;
+	(m_stack_ptr++)->as_i64 = value;
 	++m_current_argument_index;
 
 	return *this;
@@ -121,8 +229,7 @@ Runtime& Runtime::arg(f32 value)
 	assert(m_call && m_current_argument_index != m_call->arguments_count && "To many arguments given. ");
 	// assert(m_call->arguments[m_current_argument_index]->type == ast::Type::F32() && "Argument is off wrong type. ");
 
-	*((f32*)m_stack_ptr) = value;
-	m_stack_ptr += 1;
+	(m_stack_ptr++)->as_f32 = value;
 	++m_current_argument_index;
 
 	return *this;
@@ -134,9 +241,7 @@ Runtime& Runtime::arg(f64 value)
 	assert(m_call && m_current_argument_index != m_call->arguments_count && "To many arguments given. ");
 	// assert(m_call->arguments[m_current_argument_index]->type == ast::Type::F64() && "Argument is off wrong type. ");
 
-	m_stack_ptr = (i32*)(((uintptr_t)m_stack_ptr + (alignof(f64) - 1)) & (alignof(f64) - 1));
-	*((f64*)m_stack_ptr) = value;
-	m_stack_ptr += 2;
+	(m_stack_ptr++)->as_f64 = value;
 	++m_current_argument_index;
 
 	return *this;
@@ -148,9 +253,14 @@ void Runtime::call(void* return_value, ast::Type* return_type)
 	assert(m_call->arguments_count == m_current_argument_index && "To few arguments given. ");
 	assert(return_type == m_call->type->return_type && "Return type dosen't match. ");
 
+	// Like OpCall, the body is only compiled once something actually calls it.
+	const FunctionCode* code = FunctionCompiler::CodeFor(m_call);
+	assert(code && "Only functions with a body can be called. ");
 	m_call = nullptr;
 
+	FrameArena::Mark frame = enter_frame();
 	// call(return_value, code);
+	leave_frame(frame);
 }
 
 /*
@@ -1,6 +1,8 @@
 #ifndef RUNTIME_H
 #define RUNTIME_H
 #include "common.h"
+#include "tracer.h"
+#include "thread_pool.h"
 
 namespace ast {
 	struct Type;
@@ -8,6 +10,56 @@ namespace ast {
 	struct Function;
 }
 class Project;
+class Fiber;
+
+/* \brief A single slot on the operand stack, every scalar takes exactly one slot regardless of its width.
+ * Vectors take two or four consecutive ones, see simd.h.
+ */
+union Slot {
+	i32 as_i32;
+	u32 as_u32;
+	i64 as_i64;
+	u64 as_u64;
+	f32 as_f32;
+	f64 as_f64;
+	void* as_ref;
+};
+static_assert(sizeof(Slot) == 8, "Weird size of Slot");
+
+/* \brief Bump allocator for memory that dies together with the call frame that allocated it.
+ * Every call takes a mark on entry and resets to it on return, which frees all of its allocations at once.
+ * Chunks are kept after a reset so deep call chains do not keep going back to the system allocator.
+ */
+class FrameArena
+{
+	struct Chunk {
+		Chunk* m_prev;
+		Chunk* m_next;
+		i64 m_used;
+		i64 m_size;
+		alignas(8) u8 m_data[1];
+	};
+
+public:
+	struct Mark {
+		Chunk* chunk;
+		i64 used;
+	};
+
+	explicit FrameArena(i64 first_chunk_size = 64 * 1024);
+	~FrameArena();
+
+	Mark mark() const { return { m_current_chunk, m_current_chunk->m_used }; }
+	void reset(const Mark& mark);
+
+	// Returns zeroed memory aligned to 8 bytes.
+	void* allocate(i64 byte_count);
+
+private:
+	Chunk* allocate_chunk(i64 size);
+
+	Chunk* m_current_chunk;
+};
 
 /* \brief Runtime handles the stack and heap. 
  * Two runtimes can be used for the same project but will not share any managed data.
@@ -17,7 +69,7 @@ class Runtime
 public:
 	Runtime(Project* project)
 		: m_project(project) {
-		m_stack = new i32[4 * 200];
+		m_stack = new Slot[4 * 200];
 		m_stack_ptr = m_stack;
 		m_stack_end = m_stack + 4 * 200;
 
@@ -26,7 +78,11 @@ public:
 		m_heap_end = m_heap + 4 * 200;
 	}
 	~Runtime()
-	{}
+	{
+		for (auto worker : m_worker_runtimes)
+			delete worker;
+		delete m_thread_pool;
+	}
 
 	// Initializes all global variables and runs all decorators. 
 	void initialize();
@@ -46,19 +102,61 @@ public:
 
 	void call(void* return_value = nullptr, ast::Type* return_type = nullptr);
 
+	// OpCall and OpTailCall enter a frame, OpReturn and OpReturnVoid leave it again.
+	FrameArena::Mark enter_frame() { return m_active_frame_arena->mark(); }
+	void leave_frame(const FrameArena::Mark& mark) { m_active_frame_arena->reset(mark); }
+	// Backs OpFrameAlloc, only for allocations escape analysis proved to not outlive the frame.
+	void* frame_alloc(i64 byte_count) { return m_active_frame_arena->allocate(byte_count); }
+
+	// Set by FiberScheduler around resuming a fiber, null otherwise. Frames then go to the fiber's own arena,
+	// since a fiber can suspend with frames open while other fibers run on the same runtime.
+	void set_running_fiber(Fiber* fiber);
+	Fiber* running_fiber() const { return m_running_fiber; }
+
+	// Loop back edges and the instructions executed while a trace records go through here.
+	Tracer& tracer() { return m_tracer; }
+
+	// Backs OpParallelFor, runs body over [low, high) on the thread pool. Every participant gets a
+	// runtime of its own, so workers never share a stack or a frame arena.
+	void parallel_for(i64 low, i64 high, const std::function<void(Runtime& worker, i64 begin, i64 end)>& body);
+
+	// Folds the elements in [begin, end) into partial and returns the new partial.
+	typedef std::function<Slot(Runtime& worker, i64 begin, i64 end, Slot partial)> FoldChunk;
+	typedef std::function<Slot(Runtime& worker, Slot lhs, Slot rhs)> Combine;
+
+	// Backs OpParallelSum and OpParallelReduce. Every participant folds the chunks it runs into a partial of
+	// its own, starting at identity, and the partials are then combined pairwise as a tree. Chunks are taken
+	// in no particular order so combine has to be associative and commutative.
+	Slot parallel_reduce(i64 low, i64 high, Slot identity, const FoldChunk& fold, const Combine& combine);
+
 private:
 	Project* m_project;
 
 	ast::Function* m_call;
 	i32 m_current_argument_index;
 
-	i32* m_stack;
-	i32* m_stack_ptr;
-	i32* m_stack_end;
+	Slot* m_stack;
+	Slot* m_stack_ptr;
+	Slot* m_stack_end;
 
 	i64* m_heap;
 	i64* m_heap_ptr;
 	i64* m_heap_end;
+
+	FrameArena m_frame_arena;
+	// m_frame_arena, or the arena of the running fiber.
+	FrameArena* m_active_frame_arena = &m_frame_arena;
+	Fiber* m_running_fiber = nullptr;
+	Tracer m_tracer;
+
+	// Returns the runtime that owns the pool, the top-level one.
+	Runtime* ensure_thread_pool();
+
+	// Created on the first parallel loop, only the top-level runtime has a pool and workers.
+	ThreadPool* m_thread_pool = nullptr;
+	std::vector<Runtime*> m_worker_runtimes;
+	// Set on worker runtimes, the runtime whose pool they run on.
+	Runtime* m_owner = nullptr;
 };
 
 
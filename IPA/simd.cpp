@@ -0,0 +1,374 @@
+#include "simd.h"
+#include "runtime.h"
+
+#include <assert.h>
+#include <string.h>
+
+
+static const i32 VECTOR_COUNT = 6;
+static const i32 BINARY_OPERATION_COUNT = 7;
+static const i32 REDUCE_OPERATION_COUNT = 3;
+
+static_assert((i32)OpCode::OpEqS32x8 - (i32)OpCode::OpAddF32x4 + 1 == VECTOR_COUNT * BINARY_OPERATION_COUNT, "Vector opcodes out of order");
+static_assert((i32)OpCode::OpReduceMaxS32x8 - (i32)OpCode::OpReduceAddF32x4 + 1 == VECTOR_COUNT * REDUCE_OPERATION_COUNT, "Reduce opcodes out of order");
+
+static simd::BinaryKernel s_binary_kernels[VECTOR_COUNT * BINARY_OPERATION_COUNT];
+static simd::ReduceKernel s_reduce_kernels[VECTOR_COUNT * REDUCE_OPERATION_COUNT];
+static simd::ShuffleKernel s_shuffle_kernel;
+
+
+// =========================================================================================================
+// Cpu detection
+// =========================================================================================================
+
+static simd::CpuFeatures detect_cpu_features() {
+	simd::CpuFeatures features;
+#if defined(IPA_X86) && defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	int max_leaf = info[0];
+	__cpuid(info, 1);
+	features.sse2 = (info[3] & (1 << 26)) != 0;
+	bool os_saves_ymm = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6;
+	if (max_leaf >= 7 && os_saves_ymm) {
+		__cpuidex(info, 7, 0);
+		features.avx2 = (info[1] & (1 << 5)) != 0;
+	}
+#elif defined(IPA_X86)
+	__builtin_cpu_init();
+	features.sse2 = __builtin_cpu_supports("sse2") != 0;
+	features.avx2 = __builtin_cpu_supports("avx2") != 0;
+#endif
+	return features;
+}
+
+const simd::CpuFeatures& simd::cpu_features() {
+	static CpuFeatures s_features = detect_cpu_features();
+	return s_features;
+}
+
+
+// =========================================================================================================
+// Scalar kernels, used when the cpu has nothing better
+// =========================================================================================================
+
+template<typename T>
+static T lane_mask(bool value) {
+	T result;
+	memset(&result, value ? 0xFF : 0x00, sizeof(T));
+	return result;
+}
+
+struct AddOperation { template<typename T> static T apply(T a, T b) { typedef typename simd::WrappingLane<T>::Type W; return (T)((W)a + (W)b); } };
+struct SubOperation { template<typename T> static T apply(T a, T b) { typedef typename simd::WrappingLane<T>::Type W; return (T)((W)a - (W)b); } };
+struct MulOperation { template<typename T> static T apply(T a, T b) { typedef typename simd::WrappingLane<T>::Type W; return (T)((W)a * (W)b); } };
+struct DivOperation {
+	template<typename T> static T apply(T a, T b) { return a / b; }
+	// The type inferer rejects / on integer vectors, the kernel still never traps: x / 0 is 0 and INT_MIN / -1 wraps.
+	static i32 apply(i32 a, i32 b) { return b == 0 ? 0 : b == -1 ? (i32)(0u - (u32)a) : a / b; }
+};
+struct LtOperation  { template<typename T> static T apply(T a, T b) { return lane_mask<T>(a < b);  } };
+struct GtOperation  { template<typename T> static T apply(T a, T b) { return lane_mask<T>(a > b);  } };
+struct EqOperation  { template<typename T> static T apply(T a, T b) { return lane_mask<T>(a == b); } };
+struct MinOperation { template<typename T> static T apply(T a, T b) { return b < a ? b : a; } };
+struct MaxOperation { template<typename T> static T apply(T a, T b) { return b > a ? b : a; } };
+
+template<typename T, i32 N, typename Operation>
+static void scalar_binary(Slot* lhs, const Slot* rhs) {
+	T a[N], b[N];
+	memcpy(a, lhs, sizeof(a));
+	memcpy(b, rhs, sizeof(b));
+	for (i32 i = 0; i < N; i++)
+		a[i] = Operation::apply(a[i], b[i]);
+	memcpy(lhs, a, sizeof(a));
+}
+
+template<typename T, i32 N, typename Operation>
+static void scalar_reduce(Slot* value) {
+	T lanes[N];
+	memcpy(lanes, value, sizeof(lanes));
+	T result = lanes[0];
+	for (i32 i = 1; i < N; i++)
+		result = Operation::apply(result, lanes[i]);
+	memcpy(value, &result, sizeof(result));
+}
+
+static void scalar_shuffle_32x4(Slot* value, u8 control) {
+	u32 lanes[4], result[4];
+	memcpy(lanes, value, sizeof(lanes));
+	for (i32 i = 0; i < 4; i++)
+		result[i] = lanes[(control >> (2 * i)) & 3];
+	memcpy(value, result, sizeof(result));
+}
+
+template<typename T, i32 N>
+static void install_scalar_kernels(i32 vector_index) {
+	simd::BinaryKernel* binary = &s_binary_kernels[vector_index * BINARY_OPERATION_COUNT];
+	binary[0] = scalar_binary<T, N, AddOperation>;
+	binary[1] = scalar_binary<T, N, SubOperation>;
+	binary[2] = scalar_binary<T, N, MulOperation>;
+	binary[3] = scalar_binary<T, N, DivOperation>;
+	binary[4] = scalar_binary<T, N, LtOperation>;
+	binary[5] = scalar_binary<T, N, GtOperation>;
+	binary[6] = scalar_binary<T, N, EqOperation>;
+
+	simd::ReduceKernel* reduce = &s_reduce_kernels[vector_index * REDUCE_OPERATION_COUNT];
+	reduce[0] = scalar_reduce<T, N, AddOperation>;
+	reduce[1] = scalar_reduce<T, N, MinOperation>;
+	reduce[2] = scalar_reduce<T, N, MaxOperation>;
+}
+
+
+// =========================================================================================================
+// SSE2 & AVX2 kernels
+// =========================================================================================================
+
+#ifdef IPA_X86
+
+// 256 bit vectors on a cpu without AVX2 run the 128 bit kernel on each half.
+template<simd::BinaryKernel half>
+static void split_binary(Slot* lhs, const Slot* rhs) {
+	half(lhs, rhs);
+	half(lhs + 2, rhs + 2);
+}
+
+template<simd::BinaryKernel combine, simd::ReduceKernel half>
+static void split_reduce(Slot* value) {
+	Slot low[2] = { value[0], value[1] };
+	combine(low, value + 2);
+	half(low);
+	value[0] = low[0];
+}
+
+#define SSE2_BINARY_PS(name, expression) \
+	IPA_TARGET_SSE2 static void name(Slot* lhs, const Slot* rhs) { \
+		__m128 a = _mm_loadu_ps((const float*)lhs); __m128 b = _mm_loadu_ps((const float*)rhs); \
+		_mm_storeu_ps((float*)lhs, expression); }
+#define SSE2_BINARY_PD(name, expression) \
+	IPA_TARGET_SSE2 static void name(Slot* lhs, const Slot* rhs) { \
+		__m128d a = _mm_loadu_pd((const double*)lhs); __m128d b = _mm_loadu_pd((const double*)rhs); \
+		_mm_storeu_pd((double*)lhs, expression); }
+#define SSE2_BINARY_EPI32(name, expression) \
+	IPA_TARGET_SSE2 static void name(Slot* lhs, const Slot* rhs) { \
+		__m128i a = _mm_loadu_si128((const __m128i*)lhs); __m128i b = _mm_loadu_si128((const __m128i*)rhs); \
+		_mm_storeu_si128((__m128i*)lhs, expression); }
+
+#define AVX2_BINARY_PS(name, expression) \
+	IPA_TARGET_AVX2 static void name(Slot* lhs, const Slot* rhs) { \
+		__m256 a = _mm256_loadu_ps((const float*)lhs); __m256 b = _mm256_loadu_ps((const float*)rhs); \
+		_mm256_storeu_ps((float*)lhs, expression); }
+#define AVX2_BINARY_PD(name, expression) \
+	IPA_TARGET_AVX2 static void name(Slot* lhs, const Slot* rhs) { \
+		__m256d a = _mm256_loadu_pd((const double*)lhs); __m256d b = _mm256_loadu_pd((const double*)rhs); \
+		_mm256_storeu_pd((double*)lhs, expression); }
+#define AVX2_BINARY_EPI32(name, expression) \
+	IPA_TARGET_AVX2 static void name(Slot* lhs, const Slot* rhs) { \
+		__m256i a = _mm256_loadu_si256((const __m256i*)lhs); __m256i b = _mm256_loadu_si256((const __m256i*)rhs); \
+		_mm256_storeu_si256((__m256i*)lhs, expression); }
+
+SSE2_BINARY_PS(sse2_add_f32x4, _mm_add_ps(a, b))
+SSE2_BINARY_PS(sse2_sub_f32x4, _mm_sub_ps(a, b))
+SSE2_BINARY_PS(sse2_mul_f32x4, _mm_mul_ps(a, b))
+SSE2_BINARY_PS(sse2_div_f32x4, _mm_div_ps(a, b))
+SSE2_BINARY_PS(sse2_lt_f32x4,  _mm_cmplt_ps(a, b))
+SSE2_BINARY_PS(sse2_gt_f32x4,  _mm_cmpgt_ps(a, b))
+SSE2_BINARY_PS(sse2_eq_f32x4,  _mm_cmpeq_ps(a, b))
+SSE2_BINARY_PS(sse2_min_f32x4, _mm_min_ps(a, b))
+SSE2_BINARY_PS(sse2_max_f32x4, _mm_max_ps(a, b))
+
+SSE2_BINARY_PD(sse2_add_f64x2, _mm_add_pd(a, b))
+SSE2_BINARY_PD(sse2_sub_f64x2, _mm_sub_pd(a, b))
+SSE2_BINARY_PD(sse2_mul_f64x2, _mm_mul_pd(a, b))
+SSE2_BINARY_PD(sse2_div_f64x2, _mm_div_pd(a, b))
+SSE2_BINARY_PD(sse2_lt_f64x2,  _mm_cmplt_pd(a, b))
+SSE2_BINARY_PD(sse2_gt_f64x2,  _mm_cmpgt_pd(a, b))
+SSE2_BINARY_PD(sse2_eq_f64x2,  _mm_cmpeq_pd(a, b))
+SSE2_BINARY_PD(sse2_min_f64x2, _mm_min_pd(a, b))
+SSE2_BINARY_PD(sse2_max_f64x2, _mm_max_pd(a, b))
+
+// SSE2 has no 32 bit lane multiply, multiply the even and odd lanes as 64 bit and pick the low halves.
+IPA_TARGET_SSE2 static __m128i sse2_mullo_epi32(__m128i a, __m128i b) {
+	__m128i even = _mm_mul_epu32(a, b);
+	__m128i odd  = _mm_mul_epu32(_mm_srli_si128(a, 4), _mm_srli_si128(b, 4));
+	return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+SSE2_BINARY_EPI32(sse2_add_s32x4, _mm_add_epi32(a, b))
+SSE2_BINARY_EPI32(sse2_sub_s32x4, _mm_sub_epi32(a, b))
+SSE2_BINARY_EPI32(sse2_mul_s32x4, sse2_mullo_epi32(a, b))
+SSE2_BINARY_EPI32(sse2_lt_s32x4,  _mm_cmplt_epi32(a, b))
+SSE2_BINARY_EPI32(sse2_gt_s32x4,  _mm_cmpgt_epi32(a, b))
+SSE2_BINARY_EPI32(sse2_eq_s32x4,  _mm_cmpeq_epi32(a, b))
+
+AVX2_BINARY_PS(avx2_add_f32x8, _mm256_add_ps(a, b))
+AVX2_BINARY_PS(avx2_sub_f32x8, _mm256_sub_ps(a, b))
+AVX2_BINARY_PS(avx2_mul_f32x8, _mm256_mul_ps(a, b))
+AVX2_BINARY_PS(avx2_div_f32x8, _mm256_div_ps(a, b))
+AVX2_BINARY_PS(avx2_lt_f32x8,  _mm256_cmp_ps(a, b, _CMP_LT_OQ))
+AVX2_BINARY_PS(avx2_gt_f32x8,  _mm256_cmp_ps(a, b, _CMP_GT_OQ))
+AVX2_BINARY_PS(avx2_eq_f32x8,  _mm256_cmp_ps(a, b, _CMP_EQ_OQ))
+
+AVX2_BINARY_PD(avx2_add_f64x4, _mm256_add_pd(a, b))
+AVX2_BINARY_PD(avx2_sub_f64x4, _mm256_sub_pd(a, b))
+AVX2_BINARY_PD(avx2_mul_f64x4, _mm256_mul_pd(a, b))
+AVX2_BINARY_PD(avx2_div_f64x4, _mm256_div_pd(a, b))
+AVX2_BINARY_PD(avx2_lt_f64x4,  _mm256_cmp_pd(a, b, _CMP_LT_OQ))
+AVX2_BINARY_PD(avx2_gt_f64x4,  _mm256_cmp_pd(a, b, _CMP_GT_OQ))
+AVX2_BINARY_PD(avx2_eq_f64x4,  _mm256_cmp_pd(a, b, _CMP_EQ_OQ))
+
+AVX2_BINARY_EPI32(avx2_add_s32x8, _mm256_add_epi32(a, b))
+AVX2_BINARY_EPI32(avx2_sub_s32x8, _mm256_sub_epi32(a, b))
+AVX2_BINARY_EPI32(avx2_mul_s32x8, _mm256_mullo_epi32(a, b))
+AVX2_BINARY_EPI32(avx2_lt_s32x8,  _mm256_cmpgt_epi32(b, a))
+AVX2_BINARY_EPI32(avx2_gt_s32x8,  _mm256_cmpgt_epi32(a, b))
+AVX2_BINARY_EPI32(avx2_eq_s32x8,  _mm256_cmpeq_epi32(a, b))
+
+#define SSE2_REDUCE_PS(name, operation) \
+	IPA_TARGET_SSE2 static void name(Slot* value) { \
+		__m128 v = _mm_loadu_ps((const float*)value); \
+		v = operation(v, _mm_movehl_ps(v, v)); \
+		v = operation(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1))); \
+		value->as_f32 = _mm_cvtss_f32(v); }
+#define SSE2_REDUCE_PD(name, operation) \
+	IPA_TARGET_SSE2 static void name(Slot* value) { \
+		__m128d v = _mm_loadu_pd((const double*)value); \
+		v = operation(v, _mm_unpackhi_pd(v, v)); \
+		value->as_f64 = _mm_cvtsd_f64(v); }
+
+SSE2_REDUCE_PS(sse2_reduce_add_f32x4, _mm_add_ps)
+SSE2_REDUCE_PS(sse2_reduce_min_f32x4, _mm_min_ps)
+SSE2_REDUCE_PS(sse2_reduce_max_f32x4, _mm_max_ps)
+SSE2_REDUCE_PD(sse2_reduce_add_f64x2, _mm_add_pd)
+SSE2_REDUCE_PD(sse2_reduce_min_f64x2, _mm_min_pd)
+SSE2_REDUCE_PD(sse2_reduce_max_f64x2, _mm_max_pd)
+
+IPA_TARGET_AVX2 static void avx2_shuffle_32x4(Slot* value, u8 control) {
+	__m128i lanes = _mm_setr_epi32(control & 3, (control >> 2) & 3, (control >> 4) & 3, (control >> 6) & 3);
+	_mm_storeu_ps((float*)value, _mm_permutevar_ps(_mm_loadu_ps((const float*)value), lanes));
+}
+
+static void install_sse2_kernels() {
+	simd::BinaryKernel* f32x4 = &s_binary_kernels[0 * BINARY_OPERATION_COUNT];
+	f32x4[0] = sse2_add_f32x4; f32x4[1] = sse2_sub_f32x4; f32x4[2] = sse2_mul_f32x4; f32x4[3] = sse2_div_f32x4;
+	f32x4[4] = sse2_lt_f32x4;  f32x4[5] = sse2_gt_f32x4;  f32x4[6] = sse2_eq_f32x4;
+
+	simd::BinaryKernel* f64x2 = &s_binary_kernels[1 * BINARY_OPERATION_COUNT];
+	f64x2[0] = sse2_add_f64x2; f64x2[1] = sse2_sub_f64x2; f64x2[2] = sse2_mul_f64x2; f64x2[3] = sse2_div_f64x2;
+	f64x2[4] = sse2_lt_f64x2;  f64x2[5] = sse2_gt_f64x2;  f64x2[6] = sse2_eq_f64x2;
+
+	simd::BinaryKernel* s32x4 = &s_binary_kernels[2 * BINARY_OPERATION_COUNT];
+	s32x4[0] = sse2_add_s32x4; s32x4[1] = sse2_sub_s32x4; s32x4[2] = sse2_mul_s32x4;
+	s32x4[4] = sse2_lt_s32x4;  s32x4[5] = sse2_gt_s32x4;  s32x4[6] = sse2_eq_s32x4;
+
+	simd::BinaryKernel* f32x8 = &s_binary_kernels[3 * BINARY_OPERATION_COUNT];
+	f32x8[0] = split_binary<sse2_add_f32x4>; f32x8[1] = split_binary<sse2_sub_f32x4>;
+	f32x8[2] = split_binary<sse2_mul_f32x4>; f32x8[3] = split_binary<sse2_div_f32x4>;
+	f32x8[4] = split_binary<sse2_lt_f32x4>;  f32x8[5] = split_binary<sse2_gt_f32x4>; f32x8[6] = split_binary<sse2_eq_f32x4>;
+
+	simd::BinaryKernel* f64x4 = &s_binary_kernels[4 * BINARY_OPERATION_COUNT];
+	f64x4[0] = split_binary<sse2_add_f64x2>; f64x4[1] = split_binary<sse2_sub_f64x2>;
+	f64x4[2] = split_binary<sse2_mul_f64x2>; f64x4[3] = split_binary<sse2_div_f64x2>;
+	f64x4[4] = split_binary<sse2_lt_f64x2>;  f64x4[5] = split_binary<sse2_gt_f64x2>; f64x4[6] = split_binary<sse2_eq_f64x2>;
+
+	simd::BinaryKernel* s32x8 = &s_binary_kernels[5 * BINARY_OPERATION_COUNT];
+	s32x8[0] = split_binary<sse2_add_s32x4>; s32x8[1] = split_binary<sse2_sub_s32x4>; s32x8[2] = split_binary<sse2_mul_s32x4>;
+	s32x8[4] = split_binary<sse2_lt_s32x4>;  s32x8[5] = split_binary<sse2_gt_s32x4>;  s32x8[6] = split_binary<sse2_eq_s32x4>;
+
+	simd::ReduceKernel* reduce_f32x4 = &s_reduce_kernels[0 * REDUCE_OPERATION_COUNT];
+	reduce_f32x4[0] = sse2_reduce_add_f32x4; reduce_f32x4[1] = sse2_reduce_min_f32x4; reduce_f32x4[2] = sse2_reduce_max_f32x4;
+
+	simd::ReduceKernel* reduce_f64x2 = &s_reduce_kernels[1 * REDUCE_OPERATION_COUNT];
+	reduce_f64x2[0] = sse2_reduce_add_f64x2; reduce_f64x2[1] = sse2_reduce_min_f64x2; reduce_f64x2[2] = sse2_reduce_max_f64x2;
+
+	simd::ReduceKernel* reduce_f32x8 = &s_reduce_kernels[3 * REDUCE_OPERATION_COUNT];
+	reduce_f32x8[0] = split_reduce<sse2_add_f32x4, sse2_reduce_add_f32x4>;
+	reduce_f32x8[1] = split_reduce<sse2_min_f32x4, sse2_reduce_min_f32x4>;
+	reduce_f32x8[2] = split_reduce<sse2_max_f32x4, sse2_reduce_max_f32x4>;
+
+	simd::ReduceKernel* reduce_f64x4 = &s_reduce_kernels[4 * REDUCE_OPERATION_COUNT];
+	reduce_f64x4[0] = split_reduce<sse2_add_f64x2, sse2_reduce_add_f64x2>;
+	reduce_f64x4[1] = split_reduce<sse2_min_f64x2, sse2_reduce_min_f64x2>;
+	reduce_f64x4[2] = split_reduce<sse2_max_f64x2, sse2_reduce_max_f64x2>;
+}
+
+static void install_avx2_kernels() {
+	simd::BinaryKernel* f32x8 = &s_binary_kernels[3 * BINARY_OPERATION_COUNT];
+	f32x8[0] = avx2_add_f32x8; f32x8[1] = avx2_sub_f32x8; f32x8[2] = avx2_mul_f32x8; f32x8[3] = avx2_div_f32x8;
+	f32x8[4] = avx2_lt_f32x8;  f32x8[5] = avx2_gt_f32x8;  f32x8[6] = avx2_eq_f32x8;
+
+	simd::BinaryKernel* f64x4 = &s_binary_kernels[4 * BINARY_OPERATION_COUNT];
+	f64x4[0] = avx2_add_f64x4; f64x4[1] = avx2_sub_f64x4; f64x4[2] = avx2_mul_f64x4; f64x4[3] = avx2_div_f64x4;
+	f64x4[4] = avx2_lt_f64x4;  f64x4[5] = avx2_gt_f64x4;  f64x4[6] = avx2_eq_f64x4;
+
+	simd::BinaryKernel* s32x8 = &s_binary_kernels[5 * BINARY_OPERATION_COUNT];
+	s32x8[0] = avx2_add_s32x8; s32x8[1] = avx2_sub_s32x8; s32x8[2] = avx2_mul_s32x8;
+	s32x8[4] = avx2_lt_s32x8;  s32x8[5] = avx2_gt_s32x8;  s32x8[6] = avx2_eq_s32x8;
+
+	s_shuffle_kernel = avx2_shuffle_32x4;
+}
+
+#endif // IPA_X86
+
+
+// =========================================================================================================
+// Kernel lookup
+// =========================================================================================================
+
+static bool install_kernels() {
+	install_scalar_kernels<f32, 4>(0);
+	install_scalar_kernels<f64, 2>(1);
+	install_scalar_kernels<i32, 4>(2);
+	install_scalar_kernels<f32, 8>(3);
+	install_scalar_kernels<f64, 4>(4);
+	install_scalar_kernels<i32, 8>(5);
+	s_shuffle_kernel = scalar_shuffle_32x4;
+
+#ifdef IPA_X86
+	if (simd::cpu_features().sse2)
+		install_sse2_kernels();
+	if (simd::cpu_features().avx2)
+		install_avx2_kernels();
+#endif
+	return true;
+}
+
+static void ensure_kernels_installed() {
+	static bool s_installed = install_kernels();
+	(void)s_installed;
+}
+
+simd::BinaryKernel simd::get_binary_kernel(OpCode opcode) {
+	ensure_kernels_installed();
+	i32 index = (i32)opcode - (i32)OpCode::OpAddF32x4;
+	assert(index >= 0 && index < VECTOR_COUNT * BINARY_OPERATION_COUNT);
+	return s_binary_kernels[index];
+}
+
+simd::ReduceKernel simd::get_reduce_kernel(OpCode opcode) {
+	ensure_kernels_installed();
+	i32 index = (i32)opcode - (i32)OpCode::OpReduceAddF32x4;
+	assert(index >= 0 && index < VECTOR_COUNT * REDUCE_OPERATION_COUNT);
+	return s_reduce_kernels[index];
+}
+
+simd::ShuffleKernel simd::get_shuffle_kernel(OpCode opcode) {
+	ensure_kernels_installed();
+	assert(opcode == OpCode::OpShuffle32x4);
+	return s_shuffle_kernel;
+}
+
+i32 simd::get_slot_count(OpCode opcode) {
+	i32 vector_index;
+	if (opcode >= OpCode::OpAddF32x4 && opcode <= OpCode::OpEqS32x8)
+		vector_index = ((i32)opcode - (i32)OpCode::OpAddF32x4) / BINARY_OPERATION_COUNT;
+	else if (opcode >= OpCode::OpReduceAddF32x4 && opcode <= OpCode::OpReduceMaxS32x8)
+		vector_index = ((i32)opcode - (i32)OpCode::OpReduceAddF32x4) / REDUCE_OPERATION_COUNT;
+	else if (opcode == OpCode::OpShuffle32x4)
+		vector_index = 0;
+	else {
+		assert(false);
+		return 0;
+	}
+	// The first three vector primitives are 128 bit, the last three 256 bit.
+	return vector_index < 3 ? 2 : 4;
+}
@@ -0,0 +1,56 @@
+#ifndef SIMD_H
+#define SIMD_H
+#include "common.h"
+#include "opcodes.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define IPA_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define IPA_TARGET_SSE2
+#define IPA_TARGET_AVX2
+#else
+// Lets a single function use the instruction set without enabling it for the whole build.
+#define IPA_TARGET_SSE2 __attribute__((target("sse2")))
+#define IPA_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+union Slot;
+
+
+/* \brief Lane-wise kernels for the vector opcodes, the fastest version for the running cpu is picked on first use.
+ * A vector occupies consecutive stack slots, two for the 128 bit vectors and four for the 256 bit ones.
+ */
+namespace simd {
+
+	struct CpuFeatures {
+		bool sse2 = false;
+		bool avx2 = false;
+	};
+
+	const CpuFeatures& cpu_features();
+
+	// The result is written over lhs, comparisons set every lane to all ones or all zeros.
+	typedef void (*BinaryKernel)(Slot* lhs, const Slot* rhs);
+	// The reduced scalar is written to the first slot of value.
+	typedef void (*ReduceKernel)(Slot* value);
+	// Lane i of the result is lane ((control >> (2 * i)) & 3) of value.
+	typedef void (*ShuffleKernel)(Slot* value, u8 control);
+
+	BinaryKernel get_binary_kernel(OpCode opcode);
+	ReduceKernel get_reduce_kernel(OpCode opcode);
+	ShuffleKernel get_shuffle_kernel(OpCode opcode);
+
+	i32 get_slot_count(OpCode opcode);
+
+	// Integer lanes wrap around like the SSE2 and AVX2 instructions do, signed overflow is undefined so the
+	// scalar code computes them as unsigned.
+	template<typename T> struct WrappingLane { typedef T Type; };
+	template<> struct WrappingLane<i32> { typedef u32 Type; };
+	template<> struct WrappingLane<i64> { typedef u64 Type; };
+}
+
+
+#endif // SIMD_H
@@ -0,0 +1,300 @@
+#include "source_loader.h"
+#include "tokenizer.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <assert.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define IPA_IO_URING
+#endif
+#endif
+
+#ifdef IPA_IO_URING
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <linux/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+
+void SourceLoader::load() {
+	std::vector<Source*> pending;
+	for (auto source : m_sources) {
+		if (!source->is_loaded())
+			pending.push_back(source);
+	}
+	m_sources.swap(pending);
+	if (m_sources.empty())
+		return;
+
+	// A single file is not worth setting up a ring or threads for.
+	if (m_sources.size() == 1) {
+		m_sources[0]->load();
+	} else if (!load_with_io_uring()) {
+		load_with_thread_pool();
+	}
+	m_sources.clear();
+}
+
+void SourceLoader::load_with_thread_pool() {
+	std::vector<Source*> pending;
+	for (auto source : m_sources) {
+		if (!source->is_loaded())
+			pending.push_back(source);
+	}
+
+	ThreadPool pool;
+	pool.parallel_for(0, (i64)pending.size(), [&](i64 begin, i64 end, i32) {
+		for (i64 i = begin; i < end; i++)
+			pending[i]->load();
+	});
+}
+
+
+#ifdef IPA_IO_URING
+
+/* \brief Just enough of an io_uring to submit a batch of operations and wait for all of their completions.
+ */
+class IoUring
+{
+public:
+	IoUring() = default;
+	~IoUring() {
+		if (m_sqes) munmap(m_sqes, m_sqes_size);
+		if (m_cq_ptr && m_cq_ptr != m_sq_ptr) munmap(m_cq_ptr, m_cq_size);
+		if (m_sq_ptr) munmap(m_sq_ptr, m_sq_size);
+		if (m_fd >= 0) ::close(m_fd);
+	}
+
+	bool init(u32 entries) {
+		io_uring_params params = {};
+		m_fd = (i32)syscall(__NR_io_uring_setup, entries, &params);
+		if (m_fd < 0)
+			return false;
+
+		m_sq_size = params.sq_off.array + params.sq_entries * sizeof(u32);
+		m_cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+		bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+		if (single_mmap)
+			m_sq_size = m_cq_size = m_sq_size > m_cq_size ? m_sq_size : m_cq_size;
+
+		m_sq_ptr = map(m_sq_size, IORING_OFF_SQ_RING);
+		m_cq_ptr = single_mmap ? m_sq_ptr : map(m_cq_size, IORING_OFF_CQ_RING);
+		m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+		m_sqes = (io_uring_sqe*)map(m_sqes_size, IORING_OFF_SQES);
+		if (!m_sq_ptr || !m_cq_ptr || !m_sqes)
+			return false;
+
+		u8* sq = (u8*)m_sq_ptr;
+		m_sq_tail  = (u32*)(sq + params.sq_off.tail);
+		m_sq_mask  = *(u32*)(sq + params.sq_off.ring_mask);
+		m_sq_array = (u32*)(sq + params.sq_off.array);
+		m_sq_entries = params.sq_entries;
+
+		u8* cq = (u8*)m_cq_ptr;
+		m_cq_head = (u32*)(cq + params.cq_off.head);
+		m_cq_tail = (u32*)(cq + params.cq_off.tail);
+		m_cq_mask = *(u32*)(cq + params.cq_off.ring_mask);
+		m_cqes    = (io_uring_cqe*)(cq + params.cq_off.cqes);
+		return true;
+	}
+
+	u32 capacity() const { return m_sq_entries; }
+
+	io_uring_sqe* next_sqe(u8 opcode, u64 user_data) {
+		assert(m_queued < m_sq_entries);
+		u32 tail = *m_sq_tail + m_queued++;
+		u32 index = tail & m_sq_mask;
+		io_uring_sqe* sqe = &m_sqes[index];
+		*sqe = {};
+		sqe->opcode = opcode;
+		sqe->user_data = user_data;
+		m_sq_array[index] = index;
+		return sqe;
+	}
+
+	// Submits everything queued since the last call and hands each completion to on_complete.
+	template<typename OnComplete>
+	bool submit_and_wait(const OnComplete& on_complete) {
+		u32 expected = m_queued;
+		__atomic_store_n(m_sq_tail, *m_sq_tail + m_queued, __ATOMIC_RELEASE);
+		u32 to_submit = m_queued;
+		m_queued = 0;
+
+		u32 completed = 0;
+		while (completed < expected) {
+			long result = syscall(__NR_io_uring_enter, m_fd, to_submit, expected - completed, IORING_ENTER_GETEVENTS, nullptr, 0);
+			if (result < 0 && errno != EINTR)
+				return false;
+			if (result > 0)
+				to_submit -= (u32)result < to_submit ? (u32)result : to_submit;
+
+			u32 head = *m_cq_head;
+			u32 tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+			for (; head != tail; head++, completed++) {
+				const io_uring_cqe& cqe = m_cqes[head & m_cq_mask];
+				on_complete(cqe.user_data, cqe.res);
+			}
+			__atomic_store_n(m_cq_head, head, __ATOMIC_RELEASE);
+		}
+		return true;
+	}
+
+private:
+	void* map(size_t size, u64 offset) {
+		void* result = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, (off_t)offset);
+		return result == MAP_FAILED ? nullptr : result;
+	}
+
+	i32 m_fd = -1;
+	void* m_sq_ptr = nullptr;
+	void* m_cq_ptr = nullptr;
+	size_t m_sq_size = 0, m_cq_size = 0, m_sqes_size = 0;
+
+	u32* m_sq_tail = nullptr;
+	u32* m_sq_array = nullptr;
+	u32 m_sq_mask = 0;
+	u32 m_sq_entries = 0;
+	io_uring_sqe* m_sqes = nullptr;
+	u32 m_queued = 0;
+
+	u32* m_cq_head = nullptr;
+	u32* m_cq_tail = nullptr;
+	u32 m_cq_mask = 0;
+	io_uring_cqe* m_cqes = nullptr;
+};
+
+bool SourceLoader::load_with_io_uring() {
+	IoUring ring;
+	if (!ring.init(RING_ENTRIES))
+		return false;
+
+	struct File {
+		Source* source;
+		// Source::path() on a non-const source returns a copy, the ring needs a pointer that stays valid.
+		const char* path;
+		i32 fd;
+		bool failed;
+		struct statx stat;
+		// Owned until the source adopts it.
+		char* buffer;
+		// Submitted and not completed yet, the kernel may still write into the buffer.
+		bool is_reading;
+	};
+
+	// When the ring fails part way through a batch its descriptors are closed and the buffers no source
+	// adopted are freed, except those of reads still in flight.
+	auto abandon_batch = [](std::vector<File>& files) {
+		for (File& file : files) {
+			if (file.fd >= 0)
+				::close(file.fd);
+			if (!file.is_reading)
+				delete[] file.buffer;
+		}
+	};
+
+	// Open and size query go out together, so a batch holds half as many files as the ring has entries.
+	i64 batch_size = ring.capacity() / 2;
+	for (i64 first = 0; first < (i64)m_sources.size(); first += batch_size) {
+		i64 count = std::min(batch_size, (i64)m_sources.size() - first);
+		std::vector<File> files((size_t)count);
+
+		for (i64 i = 0; i < count; i++) {
+			File& file = files[i];
+			file.source = m_sources[first + i];
+			file.path = ((const Source*)file.source)->path().c_str();
+			file.fd = -1;
+			file.failed = false;
+			file.buffer = nullptr;
+			file.is_reading = false;
+
+			io_uring_sqe* open = ring.next_sqe(IORING_OP_OPENAT, (u64)i * 2);
+			open->fd = AT_FDCWD;
+			open->addr = (u64)file.path;
+			open->open_flags = O_RDONLY | O_CLOEXEC;
+
+			io_uring_sqe* stat = ring.next_sqe(IORING_OP_STATX, (u64)i * 2 + 1);
+			stat->fd = AT_FDCWD;
+			stat->addr = (u64)file.path;
+			stat->len = STATX_SIZE;
+			stat->off = (u64)&file.stat;
+		}
+		bool submitted = ring.submit_and_wait([&](u64 user_data, i32 result) {
+			File& file = files[user_data / 2];
+			if (result < 0)
+				file.failed = true;
+			else if (user_data % 2 == 0)
+				file.fd = result;
+		});
+		if (!submitted) {
+			abandon_batch(files);
+			return false;
+		}
+
+		for (i64 i = 0; i < count; i++) {
+			File& file = files[i];
+			if (file.failed)
+				continue;
+			i64 file_size = (i64)file.stat.stx_size;
+			file.buffer = Source::allocate_buffer(file_size);
+			io_uring_sqe* read = ring.next_sqe(IORING_OP_READ, (u64)i);
+			read->fd = file.fd;
+			read->addr = (u64)(file.buffer + 1);
+			read->len = (u32)file_size;
+			read->off = 0;
+			file.is_reading = true;
+		}
+		submitted = ring.submit_and_wait([&](u64 user_data, i32 result) {
+			File& file = files[user_data];
+			file.is_reading = false;
+			i64 file_size = (i64)file.stat.stx_size;
+			// Regular files are read in one go, anything short is finished with plain reads.
+			i64 done = result < 0 ? -1 : result;
+			while (done >= 0 && done < file_size) {
+				ssize_t bytes = pread(file.fd, file.buffer + 1 + done, (size_t)(file_size - done), (off_t)done);
+				done = bytes > 0 ? done + bytes : -1;
+			}
+			if (done == file_size) {
+				file.source->adopt_buffer(file.buffer, file_size);
+			} else {
+				delete[] file.buffer;
+				file.failed = true;
+			}
+			file.buffer = nullptr;
+		});
+		if (!submitted) {
+			abandon_batch(files);
+			return false;
+		}
+
+		for (i64 i = 0; i < count; i++) {
+			if (files[i].fd >= 0)
+				ring.next_sqe(IORING_OP_CLOSE, (u64)i)->fd = files[i].fd;
+		}
+		ring.submit_and_wait([&](u64 user_data, i32 result) {
+			// Kernels without the close operation reject it, close those the usual way.
+			if (result == -EINVAL)
+				::close(files[user_data].fd);
+		});
+
+		// Whatever the ring could not do, like an operation the kernel lacks, gets one more try with a plain read.
+		for (i64 i = 0; i < count; i++) {
+			if (files[i].failed)
+				files[i].source->load();
+		}
+	}
+	return true;
+}
+
+#else
+
+bool SourceLoader::load_with_io_uring() {
+	return false;
+}
+
+#endif
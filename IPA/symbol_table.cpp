@@ -0,0 +1,36 @@
+#include "symbol_table.h"
+
+#include <assert.h>
+#include <cstring>
+
+
+SymbolTable::SymbolTable() {
+	static const char* s_builtin_names[BuiltinSymbolCount] = {
+		"",
+		"global",
+		"spsc",
+		"export",
+		"soa",
+		"parallel",
+		"channel",
+	};
+
+	// NoSymbol gets a name too so symbols and indices into m_names line up, it is never looked up.
+	m_names.emplace_back(s_builtin_names[NoSymbol]);
+	for (Symbol symbol = NoSymbol + 1; symbol < BuiltinSymbolCount; symbol++) {
+		Symbol interned = intern(s_builtin_names[symbol], (i32)strlen(s_builtin_names[symbol]));
+		assert(interned == symbol && "Builtin symbols have to be interned in the order of BuiltinSymbol. ");
+	}
+}
+
+Symbol SymbolTable::intern(const char* chars, i32 length) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto it = m_symbols.find(std::string_view(chars, (size_t)length));
+	if (it != m_symbols.end())
+		return it->second;
+
+	Symbol symbol = (Symbol)m_names.size();
+	m_names.emplace_back(chars, (size_t)length);
+	m_symbols.emplace(m_names.back(), symbol);
+	return symbol;
+}
@@ -0,0 +1,49 @@
+#ifndef SYMBOL_TABLE_H
+#define SYMBOL_TABLE_H
+#include "common.h"
+
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+
+// Interned identifier, two identifiers are spelled the same exactly when their symbols are equal.
+typedef u32 Symbol;
+
+// Names the compiler itself looks for, they are interned first so their symbols are known up front.
+enum BuiltinSymbol : Symbol {
+	NoSymbol = 0,
+
+	GlobalSymbol,
+	SpscSymbol,
+	ExportSymbol,
+	SoaSymbol,
+	ParallelSymbol,
+	ChannelSymbol,
+
+	BuiltinSymbolCount,
+};
+
+
+/* \brief Project-wide table of every identifier the tokenizers have seen.
+ * Tokenizers of different modules run on different threads, so interning takes a lock. Each tokenizer
+ * keeps its own cache in front of the table, the lock is only taken once per distinct name and module.
+ */
+class SymbolTable
+{
+public:
+	SymbolTable();
+
+	Symbol intern(const char* chars, i32 length);
+
+private:
+	std::mutex m_mutex;
+	// Index is the symbol, a deque so the views in m_symbols stay valid as names are added.
+	std::deque<std::string> m_names;
+	std::unordered_map<std::string_view, Symbol> m_symbols;
+};
+
+
+#endif // SYMBOL_TABLE_H
@@ -0,0 +1,182 @@
+#include "text_kernels.h"
+
+
+static simd::TextKernels s_text_kernels;
+
+
+// =========================================================================================================
+// Scalar kernels, used when the cpu has nothing better
+// =========================================================================================================
+
+static inline bool is_identifier_char(char c) {
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+static const char* scalar_skip_identifier(const char* text) {
+	while (is_identifier_char(*text))
+		++text;
+	return text;
+}
+
+static const char* scalar_skip_digits(const char* text) {
+	while (*text >= '0' && *text <= '9')
+		++text;
+	return text;
+}
+
+static const char* scalar_skip_whitespace(const char* text) {
+	while (*text == ' ' || *text == '\t')
+		++text;
+	return text;
+}
+
+static const char* scalar_find_line_end(const char* text) {
+	while (*text && *text != '\n' && *text != '\r')
+		++text;
+	return text;
+}
+
+static const char* scalar_find_comment_mark(const char* text) {
+	while (*text && *text != '/' && *text != '*' && *text != '\n' && *text != '\r')
+		++text;
+	return text;
+}
+
+
+// =========================================================================================================
+// SSE2 and AVX2 kernels
+// =========================================================================================================
+
+#ifdef IPA_X86
+
+static inline i32 count_trailing_zeros(u32 bits) {
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, bits);
+	return (i32)index;
+#else
+	return __builtin_ctz(bits);
+#endif
+}
+
+// Skips while every byte is in the class, MEMBERS sets the bytes of a vector that are.
+#define DEFINE_TEXT_SKIP_KERNEL(name, TARGET, Vector, WIDTH, LOAD, MOVEMASK, MEMBERS) \
+	TARGET static const char* name(const char* text) { \
+		const u32 all_members = (u32)((1ull << WIDTH) - 1); \
+		while (true) { \
+			u32 members = (u32)MOVEMASK(MEMBERS(LOAD((const Vector*)text))); \
+			if (members != all_members) \
+				return text + count_trailing_zeros(~members); \
+			text += WIDTH; \
+		} \
+	}
+
+// Stops at the first byte MATCHES sets.
+#define DEFINE_TEXT_FIND_KERNEL(name, TARGET, Vector, WIDTH, LOAD, MOVEMASK, MATCHES) \
+	TARGET static const char* name(const char* text) { \
+		while (true) { \
+			u32 matches = (u32)MOVEMASK(MATCHES(LOAD((const Vector*)text))); \
+			if (matches) \
+				return text + count_trailing_zeros(matches); \
+			text += WIDTH; \
+		} \
+	}
+
+// Characters compare as signed bytes, everything past 0x7f is below the ranges and never in a class.
+IPA_TARGET_SSE2 static inline __m128i sse2_in_range(__m128i c, char low, char high) {
+	return _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8(low - 1)), _mm_cmpgt_epi8(_mm_set1_epi8(high + 1), c));
+}
+IPA_TARGET_SSE2 static inline __m128i sse2_equals(__m128i c, char value) {
+	return _mm_cmpeq_epi8(c, _mm_set1_epi8(value));
+}
+
+IPA_TARGET_SSE2 static inline __m128i sse2_identifier_chars(__m128i c) {
+	__m128i letters = sse2_in_range(_mm_or_si128(c, _mm_set1_epi8(0x20)), 'a', 'z');
+	return _mm_or_si128(_mm_or_si128(letters, sse2_in_range(c, '0', '9')), sse2_equals(c, '_'));
+}
+IPA_TARGET_SSE2 static inline __m128i sse2_digits(__m128i c) {
+	return sse2_in_range(c, '0', '9');
+}
+IPA_TARGET_SSE2 static inline __m128i sse2_whitespace(__m128i c) {
+	return _mm_or_si128(sse2_equals(c, ' '), sse2_equals(c, '\t'));
+}
+IPA_TARGET_SSE2 static inline __m128i sse2_line_ends(__m128i c) {
+	return _mm_or_si128(_mm_or_si128(sse2_equals(c, '\n'), sse2_equals(c, '\r')), sse2_equals(c, '\0'));
+}
+IPA_TARGET_SSE2 static inline __m128i sse2_comment_marks(__m128i c) {
+	return _mm_or_si128(_mm_or_si128(sse2_equals(c, '/'), sse2_equals(c, '*')), sse2_line_ends(c));
+}
+
+IPA_TARGET_AVX2 static inline __m256i avx2_in_range(__m256i c, char low, char high) {
+	return _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8(low - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8(high + 1), c));
+}
+IPA_TARGET_AVX2 static inline __m256i avx2_equals(__m256i c, char value) {
+	return _mm256_cmpeq_epi8(c, _mm256_set1_epi8(value));
+}
+
+IPA_TARGET_AVX2 static inline __m256i avx2_identifier_chars(__m256i c) {
+	__m256i letters = avx2_in_range(_mm256_or_si256(c, _mm256_set1_epi8(0x20)), 'a', 'z');
+	return _mm256_or_si256(_mm256_or_si256(letters, avx2_in_range(c, '0', '9')), avx2_equals(c, '_'));
+}
+IPA_TARGET_AVX2 static inline __m256i avx2_digits(__m256i c) {
+	return avx2_in_range(c, '0', '9');
+}
+IPA_TARGET_AVX2 static inline __m256i avx2_whitespace(__m256i c) {
+	return _mm256_or_si256(avx2_equals(c, ' '), avx2_equals(c, '\t'));
+}
+IPA_TARGET_AVX2 static inline __m256i avx2_line_ends(__m256i c) {
+	return _mm256_or_si256(_mm256_or_si256(avx2_equals(c, '\n'), avx2_equals(c, '\r')), avx2_equals(c, '\0'));
+}
+IPA_TARGET_AVX2 static inline __m256i avx2_comment_marks(__m256i c) {
+	return _mm256_or_si256(_mm256_or_si256(avx2_equals(c, '/'), avx2_equals(c, '*')), avx2_line_ends(c));
+}
+
+DEFINE_TEXT_SKIP_KERNEL(sse2_skip_identifier,   IPA_TARGET_SSE2, __m128i, 16, _mm_loadu_si128, _mm_movemask_epi8, sse2_identifier_chars)
+DEFINE_TEXT_SKIP_KERNEL(sse2_skip_digits,       IPA_TARGET_SSE2, __m128i, 16, _mm_loadu_si128, _mm_movemask_epi8, sse2_digits)
+DEFINE_TEXT_SKIP_KERNEL(sse2_skip_whitespace,   IPA_TARGET_SSE2, __m128i, 16, _mm_loadu_si128, _mm_movemask_epi8, sse2_whitespace)
+DEFINE_TEXT_FIND_KERNEL(sse2_find_line_end,     IPA_TARGET_SSE2, __m128i, 16, _mm_loadu_si128, _mm_movemask_epi8, sse2_line_ends)
+DEFINE_TEXT_FIND_KERNEL(sse2_find_comment_mark, IPA_TARGET_SSE2, __m128i, 16, _mm_loadu_si128, _mm_movemask_epi8, sse2_comment_marks)
+
+DEFINE_TEXT_SKIP_KERNEL(avx2_skip_identifier,   IPA_TARGET_AVX2, __m256i, 32, _mm256_loadu_si256, _mm256_movemask_epi8, avx2_identifier_chars)
+DEFINE_TEXT_SKIP_KERNEL(avx2_skip_digits,       IPA_TARGET_AVX2, __m256i, 32, _mm256_loadu_si256, _mm256_movemask_epi8, avx2_digits)
+DEFINE_TEXT_SKIP_KERNEL(avx2_skip_whitespace,   IPA_TARGET_AVX2, __m256i, 32, _mm256_loadu_si256, _mm256_movemask_epi8, avx2_whitespace)
+DEFINE_TEXT_FIND_KERNEL(avx2_find_line_end,     IPA_TARGET_AVX2, __m256i, 32, _mm256_loadu_si256, _mm256_movemask_epi8, avx2_line_ends)
+DEFINE_TEXT_FIND_KERNEL(avx2_find_comment_mark, IPA_TARGET_AVX2, __m256i, 32, _mm256_loadu_si256, _mm256_movemask_epi8, avx2_comment_marks)
+
+#define INSTALL_TEXT_KERNELS(prefix) \
+	s_text_kernels.skip_identifier   = prefix##_skip_identifier; \
+	s_text_kernels.skip_digits       = prefix##_skip_digits; \
+	s_text_kernels.skip_whitespace   = prefix##_skip_whitespace; \
+	s_text_kernels.find_line_end     = prefix##_find_line_end; \
+	s_text_kernels.find_comment_mark = prefix##_find_comment_mark;
+
+#endif // IPA_X86
+
+
+// =========================================================================================================
+// Kernel lookup
+// =========================================================================================================
+
+static bool install_kernels() {
+	s_text_kernels.skip_identifier   = scalar_skip_identifier;
+	s_text_kernels.skip_digits       = scalar_skip_digits;
+	s_text_kernels.skip_whitespace   = scalar_skip_whitespace;
+	s_text_kernels.find_line_end     = scalar_find_line_end;
+	s_text_kernels.find_comment_mark = scalar_find_comment_mark;
+
+#ifdef IPA_X86
+	if (simd::cpu_features().sse2) {
+		INSTALL_TEXT_KERNELS(sse2)
+	}
+	if (simd::cpu_features().avx2) {
+		INSTALL_TEXT_KERNELS(avx2)
+	}
+#endif
+	return true;
+}
+
+const simd::TextKernels& simd::get_text_kernels() {
+	static bool s_installed = install_kernels();
+	(void)s_installed;
+	return s_text_kernels;
+}
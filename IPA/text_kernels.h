@@ -0,0 +1,30 @@
+#ifndef TEXT_KERNELS_H
+#define TEXT_KERNELS_H
+#include "simd.h"
+
+
+/* \brief Character scans behind the tokenizer's identifier, number, whitespace and comment loops.
+ * Every kernel starts at text and returns the first character that ends the scan. They look at 16 or 32
+ * characters at a time and may read past the character they return, so the text has to be followed by
+ * Source::PADDING readable bytes after its terminator. The terminator always ends a scan.
+ * Like the other kernels the fastest version for the running cpu is picked on first use.
+ */
+namespace simd {
+
+	typedef const char* (*TextScanKernel)(const char* text);
+
+	struct TextKernels {
+		// Skip over runs of one character class.
+		TextScanKernel skip_identifier;   // a-z A-Z 0-9 _
+		TextScanKernel skip_digits;       // 0-9
+		TextScanKernel skip_whitespace;   // space and tab
+		// Find the next character of a set.
+		TextScanKernel find_line_end;     // \n \r \0
+		TextScanKernel find_comment_mark; // / * \n \r \0
+	};
+
+	const TextKernels& get_text_kernels();
+}
+
+
+#endif // TEXT_KERNELS_H
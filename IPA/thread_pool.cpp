@@ -0,0 +1,136 @@
+#include "thread_pool.h"
+
+#include <assert.h>
+
+
+// Chunks per participant, more chunks balance better but cost more scheduling.
+static const i64 CHUNKS_PER_PARTICIPANT = 4;
+
+// The pool the thread runs as a participant of and the participant it is, null and -1 outside of any pool.
+// A participant of one pool can start a parallel_for on another, it then runs as the caller of that one.
+static thread_local const ThreadPool* t_pool = nullptr;
+static thread_local i32 t_participant_index = -1;
+
+
+ThreadPool::ThreadPool(i32 worker_count)
+	: m_queued_tasks(0), m_stop(false) {
+	if (worker_count <= 0) {
+		i32 hardware_threads = (i32)std::thread::hardware_concurrency();
+		worker_count = hardware_threads > 1 ? hardware_threads - 1 : 1;
+	}
+
+	// The last participant is the thread calling parallel_for.
+	for (i32 i = 0; i <= worker_count; i++)
+		m_participants.push_back(new Participant());
+	for (i32 i = 0; i < worker_count; i++)
+		m_threads.emplace_back(&ThreadPool::worker_loop, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(m_sleep_mutex);
+		m_stop = true;
+	}
+	m_wake_up.notify_all();
+	for (auto& thread : m_threads)
+		thread.join();
+	for (auto participant : m_participants)
+		delete participant;
+}
+
+void ThreadPool::parallel_for(i64 low, i64 high, const RangeBody& body) {
+	if (low >= high)
+		return;
+	if (t_pool == this) {
+		body(low, high, t_participant_index);
+		return;
+	}
+
+	std::lock_guard<std::mutex> caller_lock(m_caller_mutex);
+	i32 caller_index = participant_count() - 1;
+
+	i64 count = high - low;
+	i64 chunk_count = participant_count() * CHUNKS_PER_PARTICIPANT;
+	if (chunk_count > count) chunk_count = count;
+	i64 chunk_size = (count + chunk_count - 1) / chunk_count;
+	chunk_count = (count + chunk_size - 1) / chunk_size;
+
+	std::atomic<i64> remaining(chunk_count);
+	for (i64 i = 0; i < chunk_count; i++) {
+		Task task;
+		task.begin = low + i * chunk_size;
+		task.end = task.begin + chunk_size < high ? task.begin + chunk_size : high;
+		task.body = &body;
+		task.remaining = &remaining;
+
+		Participant* participant = m_participants[i % participant_count()];
+		std::lock_guard<std::mutex> lock(participant->mutex);
+		participant->tasks.push_back(task);
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_sleep_mutex);
+		m_queued_tasks += (i32)chunk_count;
+	}
+	m_wake_up.notify_all();
+
+	const ThreadPool* outer_pool = t_pool;
+	i32 outer_participant_index = t_participant_index;
+	t_pool = this;
+	t_participant_index = caller_index;
+	while (remaining.load() > 0) {
+		Task task;
+		if (pop_or_steal(caller_index, task))
+			run(task, caller_index);
+		else
+			std::this_thread::yield();
+	}
+	t_pool = outer_pool;
+	t_participant_index = outer_participant_index;
+}
+
+bool ThreadPool::pop_or_steal(i32 participant_index, Task& task) {
+	{
+		Participant* own = m_participants[participant_index];
+		std::lock_guard<std::mutex> lock(own->mutex);
+		if (!own->tasks.empty()) {
+			task = own->tasks.back();
+			own->tasks.pop_back();
+			--m_queued_tasks;
+			return true;
+		}
+	}
+
+	for (i32 i = 1; i < participant_count(); i++) {
+		Participant* victim = m_participants[(participant_index + i) % participant_count()];
+		std::lock_guard<std::mutex> lock(victim->mutex);
+		if (!victim->tasks.empty()) {
+			task = victim->tasks.front();
+			victim->tasks.pop_front();
+			--m_queued_tasks;
+			return true;
+		}
+	}
+	return false;
+}
+
+void ThreadPool::run(const Task& task, i32 participant_index) {
+	(*task.body)(task.begin, task.end, participant_index);
+	task.remaining->fetch_sub(1);
+}
+
+void ThreadPool::worker_loop(i32 participant_index) {
+	t_pool = this;
+	t_participant_index = participant_index;
+	while (true) {
+		Task task;
+		if (pop_or_steal(participant_index, task)) {
+			run(task, participant_index);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(m_sleep_mutex);
+		m_wake_up.wait(lock, [this]() { return m_stop || m_queued_tasks > 0; });
+		if (m_stop)
+			return;
+	}
+}
@@ -0,0 +1,61 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+#include "common.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+
+/* \brief Fixed set of worker threads that balance work by stealing.
+ * Every participant owns a deque, it takes its own tasks from the back while idle participants steal
+ * from the front of the others. The thread that starts a parallel_for participates as well.
+ */
+class ThreadPool
+{
+public:
+	typedef std::function<void(i64 begin, i64 end, i32 participant_index)> RangeBody;
+
+	// A worker count of zero uses one worker per hardware thread besides the calling one.
+	explicit ThreadPool(i32 worker_count = 0);
+	~ThreadPool();
+
+	// Workers plus the thread calling parallel_for, participant indices are below this.
+	i32 participant_count() const { return (i32)m_participants.size(); }
+
+	// Splits [low, high) into chunks and blocks until body ran on all of them.
+	// Nested calls from inside a body run serially on the participant that made them.
+	void parallel_for(i64 low, i64 high, const RangeBody& body);
+
+private:
+	struct Task {
+		i64 begin, end;
+		const RangeBody* body;
+		std::atomic<i64>* remaining;
+	};
+
+	struct Participant {
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	bool pop_or_steal(i32 participant_index, Task& task);
+	void run(const Task& task, i32 participant_index);
+	void worker_loop(i32 participant_index);
+
+	std::vector<Participant*> m_participants;
+	std::vector<std::thread> m_threads;
+
+	std::mutex m_sleep_mutex;
+	std::condition_variable m_wake_up;
+	std::atomic<i32> m_queued_tasks;
+	std::atomic<bool> m_stop;
+	// Only one parallel_for can own the calling participant slot at a time.
+	std::mutex m_caller_mutex;
+};
+
+
+#endif // THREAD_POOL_H
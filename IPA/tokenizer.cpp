@@ -1,34 +1,55 @@
 #include "tokenizer.h"
 #include "project.h"
 #include "compiler.h"
+#include "text_kernels.h"
 
 #include <fstream>
 #include <iostream>
+#include <limits>
 #include <assert.h>
 
 
-Source::Source(const std::string& path) 
+Source::Source(const std::string& path, bool load_now) 
 	: m_path(path), m_start(nullptr), m_end(nullptr) {
-	std::ifstream stream(path, std::ios::binary);
+	if (load_now)
+		load();
+}
+
+Source::~Source() {
+	delete[] m_buffer;
+}
+
+void Source::load() {
+	std::ifstream stream(m_path, std::ios::binary);
 	if (!stream)
 		return;
 
 	stream.seekg(0, std::ios::end);
 	const auto file_size = (i64)stream.tellg();
 
-	char* file_data = new char[file_size + 2];
-
-	m_start = file_data + 1;
-	m_end   = file_data + file_size + 1;
+	char* file_data = allocate_buffer(file_size);
 
 	stream.seekg(0, std::ios::beg);
 	stream.read(file_data + 1, file_size);
-	file_data[0] = '\n';
-	file_data[file_size + 1] = '\0';
+	adopt_buffer(file_data, file_size);
 
 	stream.close();
 }
 
+char* Source::allocate_buffer(i64 file_size) {
+	return new char[file_size + 2 + Source::PADDING];
+}
+
+void Source::adopt_buffer(char* buffer, i64 file_size) {
+	buffer[0] = '\n';
+	memset(buffer + file_size + 1, 0, 1 + Source::PADDING);
+
+	delete[] m_buffer;
+	m_buffer = buffer;
+	m_start = buffer + 1;
+	m_end   = buffer + file_size + 1;
+}
+
 const char* Token::TokenTypeToString(TokenType type) {
 	switch (type)
 	{
@@ -145,6 +166,12 @@ const char* Token::PrimitiveToString(Primitive primitive) {
 	case Primitive::U64Primitive:  return "u64";
 	case Primitive::F32Primitive:  return "f32";
 	case Primitive::F64Primitive:  return "f64";
+	case Primitive::F32x4Primitive: return "f32x4";
+	case Primitive::F64x2Primitive: return "f64x2";
+	case Primitive::S32x4Primitive: return "s32x4";
+	case Primitive::F32x8Primitive: return "f32x8";
+	case Primitive::F64x4Primitive: return "f64x4";
+	case Primitive::S32x8Primitive: return "s32x8";
 	default:
 		assert(false);
 		break;
@@ -183,43 +210,80 @@ std::string Token::to_str() const {
 }
 
 
-Tokenizer::Tokenizer(ModuleCompiler* module_compiler)
-	: m_module_compiler(module_compiler), m_stop_tokenizing(false) {
+Tokenizer::Tokenizer(ModuleCompiler* module_compiler, bool keep_tokens)
+	: m_module_compiler(module_compiler), m_stop_tokenizing(false), m_keep_tokens(keep_tokens) {
+	m_symbols = &module_compiler->module()->project()->symbols();
+	m_text_kernels = &simd::get_text_kernels();
 	m_start   = module_compiler->source()->start(); 
 	m_current = module_compiler->source()->start(); 
 	m_end     = module_compiler->source()->end();
-	tokenize();
+	if (m_keep_tokens)
+		tokenize_ahead(std::numeric_limits<i32>::max());
+	else
+		m_tokens.resize(STREAM_BUFFER_SIZE);
 }
 
 Token Tokenizer::eat() {
-	if (m_current_token == m_tokens.size())
-		return m_tokens.back();
-	return m_tokens[m_current_token++];
+	Token token = peek();
+	if (buffered_count() == 0)
+		return token;
+	if (m_keep_tokens) {
+		++m_current_token;
+	} else {
+		m_current_token = token_index(1);
+		--m_buffered_count;
+	}
+	return token;
 }
 
-void Tokenizer::tokenize() {
-	while (!m_stop_tokenizing) {
+bool Tokenizer::tokenize_ahead(i32 count) {
+	while (buffered_count() < count && !m_stop_tokenizing) {
+		tokenize_next();
+		if (m_stop_tokenizing)
+			push_token(Token(TokenType::EOFToken, m_current, 1, m_current_line_number));
+	}
+	return buffered_count() >= count;
+}
+
+void Tokenizer::tokenize_next() {
+	if (m_at_line_start) {
+		m_at_line_start = false;
 		tokenize_scopes();
+		return;
+	}
 
-		while (!m_stop_tokenizing) {
-			skip_whitespace_and_comments();
+	skip_whitespace_and_comments();
+	if (*m_current == '\n' || *m_current == '\r') {
+		tokenize_eol();
+		m_at_line_start = true;
+	} else if (*m_current == '\0') {
+		tokenize_eof();
+	} else if (is_digit() || 
+		(*m_current == '.' && m_current[1] >= '0' && m_current[1] <= '9')) {
+		tokenize_number();
+	} else if (is_identifier()) {
+		tokenize_identifier();
+	} else
+		tokenize_operand();
+}
 
-			if (*m_current == '\n' || *m_current == '\r') {
-				tokenize_eol();
-				break;
-			} else if (*m_current == '\0') {
-				tokenize_eof();
-			} else if (is_digit() || 
-				(*m_current == '.' && m_current[1] >= '0' && m_current[1] <= '9')) {
-				tokenize_number();
-			} else if (is_identifier()) {
-				tokenize_identifier();
-			} else
-				tokenize_operand();
-		}
+void Tokenizer::push_token(const Token& token) {
+	m_last_token = token;
+	if (m_keep_tokens) {
+		m_tokens.push_back(token);
+		return;
 	}
 
-	m_tokens.push_back(Token(TokenType::EOFToken, m_current, 1, m_current_line_number));
+	if (m_buffered_count == (i32)m_tokens.size()) {
+		std::vector<Token> ring(m_tokens.size() * 2);
+		for (i32 i = 0; i < m_buffered_count; i++)
+			ring[i] = m_tokens[token_index(i)];
+		m_tokens.swap(ring);
+		m_current_token = 0;
+	}
+	m_tokens[token_index(m_buffered_count)] = token;
+	++m_buffered_count;
+	++m_produced_count;
 }
 
 void Tokenizer::tokenize_scopes() {
@@ -277,11 +341,11 @@ void Tokenizer::tokenize_scopes() {
 		} else {
 			if (new_indention == m_indention_level + 1) {
 				m_indention_level = new_indention;
-				m_tokens.push_back(Token(TokenType::ScopeBegToken, first_char_of_indent, m_current - first_char_of_indent, m_current_line_number));
+				push_token(Token(TokenType::ScopeBegToken, first_char_of_indent, m_current - first_char_of_indent, m_current_line_number));
 			} else {
 				while (new_indention < m_indention_level) {
 					--m_indention_level;
-					m_tokens.push_back(Token(TokenType::ScopeEndToken, first_char_of_line, m_current - first_char_of_line, m_current_line_number));
+					push_token(Token(TokenType::ScopeEndToken, first_char_of_line, m_current - first_char_of_line, m_current_line_number));
 				}
 			}
 		}
@@ -292,85 +356,174 @@ void Tokenizer::tokenize_number() {
 	const char* start = m_current;
 	bool found_decimal = false;
 
-	while (is_digit() || *m_current == '.') {
-		if (*m_current == '.') {
-			if (found_decimal || m_current[1] == '.') 
-				break;
-			found_decimal = true;
-		}
+	while (true) {
+		m_current = m_text_kernels->skip_digits(m_current);
+		if (*m_current != '.' || found_decimal || m_current[1] == '.')
+			break;
+		found_decimal = true;
 		++m_current;
 	}
 
-	m_tokens.push_back(Token(TokenType::NumberToken, start, m_current - start, m_current_line_number));
+	push_token(Token(TokenType::NumberToken, start, m_current - start, m_current_line_number));
 }
 
-void Tokenizer::tokenize_identifier() {
-	const char* start = m_current++;
+// =========================================================================================================
+// Reserved words
+// =========================================================================================================
+
+// Keywords, primitive types and the keyword operands, looked up with a perfect hash built at compile time.
+struct ReservedWord {
+	const char* name;
+	TokenType type;
+	u8 value;
+};
+
+static constexpr ReservedWord s_reserved_words[] = {
+	{ "import",   TokenType::KeywordToken, (u8)Keyword::ImportKeyword   },
+	{ "from",     TokenType::KeywordToken, (u8)Keyword::FromKeyword     },
+	{ "as",       TokenType::KeywordToken, (u8)Keyword::AsKeyword       },
+	{ "true",     TokenType::KeywordToken, (u8)Keyword::TrueKeyword     },
+	{ "false",    TokenType::KeywordToken, (u8)Keyword::FalseKeyword    },
+	{ "struct",   TokenType::KeywordToken, (u8)Keyword::StructKeyword   },
+	{ "pass",     TokenType::KeywordToken, (u8)Keyword::PassKeyword     },
+	{ "return",   TokenType::KeywordToken, (u8)Keyword::ReturnKeyword   },
+	{ "while",    TokenType::KeywordToken, (u8)Keyword::WhileKeyword    },
+	{ "for",      TokenType::KeywordToken, (u8)Keyword::ForKeyword      },
+	{ "in",       TokenType::KeywordToken, (u8)Keyword::InKeyword       },
+	{ "break",    TokenType::KeywordToken, (u8)Keyword::BreakKeyword    },
+	{ "continue", TokenType::KeywordToken, (u8)Keyword::ContinueKeyword },
+	{ "if",       TokenType::KeywordToken, (u8)Keyword::IfKeyword       },
+	{ "elif",     TokenType::KeywordToken, (u8)Keyword::ElifKeyword     },
+	{ "else",     TokenType::KeywordToken, (u8)Keyword::ElseKeyword     },
+	{ "new",      TokenType::KeywordToken, (u8)Keyword::NewKeyword      },
+
+	{ "and",      TokenType::OperandToken, (u8)Operand::AndOperand      },
+	{ "or",       TokenType::OperandToken, (u8)Operand::OrOperand       },
+
+	{ "void",     TokenType::PrimitiveToken, (u8)Primitive::VoidPrimitive  },
+	{ "bool",     TokenType::PrimitiveToken, (u8)Primitive::BoolPrimitive  },
+	{ "s8",       TokenType::PrimitiveToken, (u8)Primitive::S8Primitive    },
+	{ "u8",       TokenType::PrimitiveToken, (u8)Primitive::U8Primitive    },
+	{ "s16",      TokenType::PrimitiveToken, (u8)Primitive::S16Primitive   },
+	{ "u16",      TokenType::PrimitiveToken, (u8)Primitive::U16Primitive   },
+	{ "s32",      TokenType::PrimitiveToken, (u8)Primitive::S32Primitive   },
+	{ "u32",      TokenType::PrimitiveToken, (u8)Primitive::U32Primitive   },
+	{ "s64",      TokenType::PrimitiveToken, (u8)Primitive::S64Primitive   },
+	{ "u64",      TokenType::PrimitiveToken, (u8)Primitive::U64Primitive   },
+	{ "f32",      TokenType::PrimitiveToken, (u8)Primitive::F32Primitive   },
+	{ "f64",      TokenType::PrimitiveToken, (u8)Primitive::F64Primitive   },
+	{ "f32x4",    TokenType::PrimitiveToken, (u8)Primitive::F32x4Primitive },
+	{ "f64x2",    TokenType::PrimitiveToken, (u8)Primitive::F64x2Primitive },
+	{ "s32x4",    TokenType::PrimitiveToken, (u8)Primitive::S32x4Primitive },
+	{ "f32x8",    TokenType::PrimitiveToken, (u8)Primitive::F32x8Primitive },
+	{ "f64x4",    TokenType::PrimitiveToken, (u8)Primitive::F64x4Primitive },
+	{ "s32x8",    TokenType::PrimitiveToken, (u8)Primitive::S32x8Primitive },
+};
+
+static const i32 RESERVED_WORD_COUNT = sizeof(s_reserved_words) / sizeof(s_reserved_words[0]);
+static const i32 MIN_RESERVED_WORD_LENGTH = 2;
+static const i32 MAX_RESERVED_WORD_LENGTH = 8;
+static const i32 RESERVED_WORD_SLOT_BITS = 7;
+
+static constexpr i32 constexpr_length(const char* str) {
+	i32 length = 0;
+	while (str[length])
+		++length;
+	return length;
+}
 
-	while (is_identifier() || is_digit()) {
-		++m_current;
+// The first two and the last character together with the length tell all reserved words apart.
+static constexpr u32 reserved_word_key(const char* start, i32 length) {
+	return (u32)(u8)start[0] | (u32)(u8)start[1] << 8 | (u32)(u8)start[length - 1] << 16 | (u32)length << 24;
+}
+
+static constexpr u32 reserved_word_slot(u32 key, u32 seed) {
+	return (key * seed) >> (32 - RESERVED_WORD_SLOT_BITS);
+}
+
+struct ReservedWordTable {
+	u32 seed;
+	// Index into s_reserved_words, -1 for slots no reserved word hashes to.
+	i8 slots[1 << RESERVED_WORD_SLOT_BITS];
+	// Key of the word in each slot, most identifiers are turned away by it without comparing text.
+	u32 keys[1 << RESERVED_WORD_SLOT_BITS];
+};
+
+// Tries multipliers until every reserved word lands in its own slot, a seed of 0 means none was found.
+static constexpr ReservedWordTable build_reserved_word_table() {
+	for (u32 attempt = 1; attempt < (1 << 16); attempt++) {
+		ReservedWordTable table = { (attempt * 0x9E3779B9u) | 1, {}, {} };
+		for (i32 i = 0; i < (1 << RESERVED_WORD_SLOT_BITS); i++)
+			table.slots[i] = -1;
+
+		bool is_perfect = true;
+		for (i32 i = 0; i < RESERVED_WORD_COUNT && is_perfect; i++) {
+			const char* name = s_reserved_words[i].name;
+			u32 key = reserved_word_key(name, constexpr_length(name));
+			u32 slot = reserved_word_slot(key, table.seed);
+			if (table.slots[slot] != -1)
+				is_perfect = false;
+			table.slots[slot] = (i8)i;
+			table.keys[slot] = key;
+		}
+		if (is_perfect)
+			return table;
 	}
+	return { 0, {}, {} };
+}
+
+static constexpr ReservedWordTable s_reserved_word_table = build_reserved_word_table();
+static_assert(s_reserved_word_table.seed != 0, "No perfect hash for the reserved words, add slot bits. ");
+
+static const ReservedWord* get_reserved_word_or_null(const char* start, i32 length) {
+	if (length < MIN_RESERVED_WORD_LENGTH || length > MAX_RESERVED_WORD_LENGTH)
+		return nullptr;
+	u32 key = reserved_word_key(start, length);
+	u32 slot = reserved_word_slot(key, s_reserved_word_table.seed);
+	i8 index = s_reserved_word_table.slots[slot];
+	if (index < 0 || s_reserved_word_table.keys[slot] != key)
+		return nullptr;
+	// Equal keys mean equal lengths, the text in between still has to match.
+	const ReservedWord* word = &s_reserved_words[index];
+	return memcmp(word->name, start, length) == 0 ? word : nullptr;
+}
+
+void Tokenizer::tokenize_identifier() {
+	const char* start = m_current;
+	m_current = m_text_kernels->skip_identifier(m_current + 1);
 
 	int length = m_current - start;
-	Primitive primitive    = Primitive::NoPrimitive;
-	Keyword keyword = Keyword::NoKeyword;
-	Operand operand = Operand::NoOperand;
-	switch (length)
+	const ReservedWord* word = get_reserved_word_or_null(start, length);
+	if (!word) {
+		push_token(Token(TokenType::IdentifierToken, start, length, m_current_line_number, intern(start, length)));
+		return;
+	}
+
+	switch (word->type)
 	{
-	case(2):
-		if      (memcmp(start, "if", length) == 0) keyword = Keyword::IfKeyword;
-		else if (memcmp(start, "in", length) == 0) keyword = Keyword::InKeyword;
-		else if (memcmp(start, "as", length) == 0) keyword = Keyword::AsKeyword;
-		else if (memcmp(start, "or", length) == 0) operand = Operand::OrOperand;
-		else if (memcmp(start, "s8", length) == 0) primitive = Primitive::S8Primitive;
-		else if (memcmp(start, "u8", length) == 0) primitive = Primitive::U8Primitive;
-		break;
-	case(3):
-		if      (memcmp(start, "for", length) == 0) keyword = Keyword::ForKeyword;
-		else if (memcmp(start, "and", length) == 0) operand = Operand::AndOperand;
-		else if (memcmp(start, "new", length) == 0) keyword = Keyword::NewKeyword;
-		else if (memcmp(start, "s16", length) == 0) primitive = Primitive::S16Primitive;
-		else if (memcmp(start, "u16", length) == 0) primitive = Primitive::U16Primitive;
-		else if (memcmp(start, "s32", length) == 0) primitive = Primitive::S32Primitive;
-		else if (memcmp(start, "u32", length) == 0) primitive = Primitive::U32Primitive;
-		else if (memcmp(start, "s64", length) == 0) primitive = Primitive::S64Primitive;
-		else if (memcmp(start, "u64", length) == 0) primitive = Primitive::U64Primitive;
-		else if (memcmp(start, "f32", length) == 0) primitive = Primitive::F32Primitive;
-		else if (memcmp(start, "f64", length) == 0) primitive = Primitive::F64Primitive;
+	case TokenType::KeywordToken:
+		push_token(Token((Keyword)word->value, start, length, m_current_line_number));
 		break;
-	case(4):
-		if      (memcmp(start, "elif", length) == 0) keyword = Keyword::ElifKeyword;
-		else if (memcmp(start, "else", length) == 0) keyword = Keyword::ElseKeyword;
-		else if (memcmp(start, "pass", length) == 0) keyword = Keyword::PassKeyword;
-		else if (memcmp(start, "from", length) == 0) keyword = Keyword::FromKeyword;
-		else if (memcmp(start, "true", length) == 0) keyword = Keyword::TrueKeyword;
-		else if (memcmp(start, "void", length) == 0) primitive = Primitive::VoidPrimitive;
-		else if (memcmp(start, "bool", length) == 0) primitive = Primitive::BoolPrimitive;
+	case TokenType::PrimitiveToken:
+		push_token(Token((Primitive)word->value, start, length, m_current_line_number));
 		break;
-	case(5):
-		if      (memcmp(start, "while", length) == 0) keyword = Keyword::WhileKeyword;
-		else if (memcmp(start, "break", length) == 0) keyword = Keyword::BreakKeyword;
-		else if (memcmp(start, "false", length) == 0) keyword = Keyword::FalseKeyword;
+	case TokenType::OperandToken:
+		push_token(Token((Operand)word->value, start, length, m_current_line_number));
 		break;
-	case(6):
-		if      (memcmp(start, "import", length) == 0) keyword = Keyword::ImportKeyword;
-		else if (memcmp(start, "return", length) == 0) keyword = Keyword::ReturnKeyword;
-		else if (memcmp(start, "struct", length) == 0) keyword = Keyword::StructKeyword;
-		break;
-	case(8):
-		if (memcmp(start, "continue", length) == 0) keyword = Keyword::ContinueKeyword;
+	default:
+		assert(false);
 		break;
 	}
+}
 
-	if (keyword != Keyword::NoKeyword) {
-		m_tokens.push_back(Token(keyword, start, length, m_current_line_number));
-	} else if (primitive != Primitive::NoPrimitive) {
-		m_tokens.push_back(Token(primitive, start, length, m_current_line_number));
-	} else if (operand != Operand::NoOperand) {
-		m_tokens.push_back(Token(operand, start, length, m_current_line_number));
-	} else {
-		m_tokens.push_back(Token(TokenType::IdentifierToken, start, length, m_current_line_number));
-	}
+Symbol Tokenizer::intern(const char* start, int length) {
+	std::string_view name(start, (size_t)length);
+	auto it = m_symbol_cache.find(name);
+	if (it != m_symbol_cache.end())
+		return it->second;
+	Symbol symbol = m_symbols->intern(start, length);
+	m_symbol_cache.emplace(name, symbol);
+	return symbol;
 }
 
 void Tokenizer::tokenize_operand() {
@@ -458,7 +611,7 @@ void Tokenizer::tokenize_operand() {
 	case(':'): operand = Operand::ColonOperand; break;
 	case('@'): operand = Operand::AtOperand;    break;
 	case(';'): {
-		m_tokens.push_back(Token(TokenType::StmtEndToken, start, m_current - start, m_current_line_number));
+		push_token(Token(TokenType::StmtEndToken, start, m_current - start, m_current_line_number));
 		return;
 	}
 
@@ -474,14 +627,14 @@ void Tokenizer::tokenize_operand() {
 		operand = double_operand;
 	}
 
-	m_tokens.push_back(Token(operand, start, m_current - start, m_current_line_number));
+	push_token(Token(operand, start, m_current - start, m_current_line_number));
 	if (is_opening_bracket) {
-		m_opening_brackets.push(m_tokens.back());
+		m_opening_brackets.push(m_last_token);
 	} else if (is_closing_bracket) {
 		if (m_opening_brackets.empty()) {
 			raise_error()
 				->message("No opening bracket found, the closing bracket was found here: ")
-				->highlight_token(m_tokens.back());
+				->highlight_token(m_last_token);
 		} else {
 			bool matched = (operand == Operand::RSquareBracketOperand && m_opening_brackets.top().operand() == Operand::LSquareBracketOperand) ||
 				           (operand == Operand::RCurlyBracketOperand  && m_opening_brackets.top().operand() == Operand::LCurlyBracketOperand ) || 
@@ -490,7 +643,7 @@ void Tokenizer::tokenize_operand() {
 				raise_error()
 					->message("Mismatched brackets, opening and closing bracket found here: ")
 					->highlight_token(m_opening_brackets.top())
-					->highlight_token(m_tokens.back());
+					->highlight_token(m_last_token);
 			}
 			m_opening_brackets.pop();
 		}
@@ -537,7 +690,7 @@ void Tokenizer::tokenize_string() {
 	}
 	++m_current;
 
-	m_tokens.push_back(Token(TokenType::StringToken, start, m_current - start, m_current_line_number));
+	push_token(Token(TokenType::StringToken, start, m_current - start, m_current_line_number));
 }
 
 void Tokenizer::tokenize_eol() {
@@ -545,7 +698,7 @@ void Tokenizer::tokenize_eol() {
 	if (*m_current == '\r') ++m_current;
 	if (*m_current == '\n') ++m_current;
 	if (m_opening_brackets.empty())
-		m_tokens.push_back(Token(TokenType::StmtEndToken, first, m_current - first, m_current_line_number));
+		push_token(Token(TokenType::StmtEndToken, first, m_current - first, m_current_line_number));
 	++m_current_line_number;
 }
 
@@ -557,15 +710,15 @@ void Tokenizer::tokenize_eof() {
 		m_opening_brackets.pop();
 	}
 
-	if (!m_tokens.back().is(TokenType::ScopeEndToken) && !m_tokens.back().is(TokenType::StmtEndToken))
-		m_tokens.push_back(Token(TokenType::StmtEndToken, m_current, 1, m_current_line_number));
+	if (!m_last_token.is(TokenType::ScopeEndToken) && !m_last_token.is(TokenType::StmtEndToken))
+		push_token(Token(TokenType::StmtEndToken, m_current, 1, m_current_line_number));
 
 	while (m_indention_level > 0) {
-		m_tokens.push_back(Token(TokenType::ScopeEndToken, m_current, 1, m_current_line_number));
+		push_token(Token(TokenType::ScopeEndToken, m_current, 1, m_current_line_number));
 		--m_indention_level;
 	}
 
-	m_tokens.push_back(Token(TokenType::EOFToken, m_current, 1, m_current_line_number));
+	push_token(Token(TokenType::EOFToken, m_current, 1, m_current_line_number));
 	m_stop_tokenizing = true;
 }
 
@@ -576,23 +729,19 @@ void Tokenizer::skip_new_line() {
 }
 
 void Tokenizer::skip_whitespace_and_comments() {
-	while (is_whitespace())
-		++m_current;
+	m_current = m_text_kernels->skip_whitespace(m_current);
 	while (m_current[0] == '/' && (m_current[1] == '/' || m_current[1] == '*')) {
 		if (m_current[1] == '/') {
-			m_current += 2;
-			while (*m_current) {
-				if (*m_current == '\n' || *m_current == '\r') {
-					skip_new_line();
-					break;
-				}
-				++m_current;
-			}
+			m_current = m_text_kernels->find_line_end(m_current + 2);
+			if (*m_current)
+				skip_new_line();
 		} else {
 			const char* start = m_current;
 			int nested_comments = 1;
 			m_current += 2;
 			while (nested_comments) {
+				// Only comment marks and line ends need a closer look.
+				m_current = m_text_kernels->find_comment_mark(m_current);
 				if (m_current[0] == '/' && m_current[1] == '*') {
 					m_current += 2;
 					++nested_comments;
@@ -611,8 +760,7 @@ void Tokenizer::skip_whitespace_and_comments() {
 			}
 		}
 	
-		while (is_whitespace())
-			++m_current;
+		m_current = m_text_kernels->skip_whitespace(m_current);
 	}
 	
 }
@@ -627,12 +775,10 @@ bool Tokenizer::is_digit() {
 	return (c >= '0' && c <= '9');
 }
 
-bool Tokenizer::is_whitespace() {
-	char c = *m_current;
-	return c == ' ' || c == '\t';
-}
-
 CompilerError* Tokenizer::raise_error() {
+	if (!m_encountered_error)
+		m_error_token_count = produced_count();
 	m_stop_tokenizing = true;
+	m_encountered_error = true;
 	return m_module_compiler->raise_error();
 }
@@ -1,15 +1,21 @@
 #ifndef TOKENIZER_H
 #define TOKENIZER_H
 #include "common.h"
+#include "symbol_table.h"
 
+#include <assert.h>
+#include <cstring>
 #include <queue>
 #include <stack>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 
 
 class Source;
 class ModuleCompiler;
 class CompilerError;
+namespace simd { struct TextKernels; }
 
 enum class TokenType : u8 {
 	ErrorToken,
@@ -130,6 +136,13 @@ enum class Primitive : u8 {
 	F32Primitive,
 	F64Primitive,
 
+	F32x4Primitive,
+	F64x2Primitive,
+	S32x4Primitive,
+	F32x8Primitive,
+	F64x4Primitive,
+	S32x8Primitive,
+
 	PrimtiveCount,
 };
 
@@ -143,8 +156,8 @@ public:
 	static const char* PrimitiveToString(Primitive primtive);
 
 	Token() = default;
-	Token(TokenType type, const char* start, int length, int line_number)
-		: m_type(type), m_first_char(start), m_length(length), m_line_number(line_number)
+	Token(TokenType type, const char* start, int length, int line_number, Symbol symbol = NoSymbol)
+		: m_type(type), m_symbol(symbol), m_first_char(start), m_length(length), m_line_number(line_number)
 	{}
 	Token(Operand operand, const char* start, int length, int line_number)
 		: m_type(TokenType::OperandToken), m_operand(operand), m_first_char(start), m_length(length), m_line_number(line_number)
@@ -160,10 +173,14 @@ public:
 	Operand operand() const { return m_operand; }
 	Keyword keyword() const { return m_keyword; }
 	Primitive primitive() const { return m_primitive; }
+	// Set on identifiers by the tokenizer, tokens made up by the compiler have none.
+	Symbol symbol() const { return m_symbol; }
 
 	std::string to_str() const;
 
 	bool equals(const Token& other) const { 
+		if (m_symbol != NoSymbol && other.m_symbol != NoSymbol)
+			return m_symbol == other.m_symbol;
 		return m_length == other.m_length ? std::memcmp(m_first_char, other.m_first_char, m_length) == 0 : false;  
 	}
 
@@ -184,6 +201,7 @@ private:
 	Keyword   m_keyword = Keyword::NoKeyword;
 	Operand   m_operand = Operand::NoOperand;
 	Primitive m_primitive = Primitive::NoPrimitive;
+	Symbol    m_symbol    = NoSymbol;
 
 	int m_length = 0;
 	int m_line_number = -1;
@@ -193,8 +211,9 @@ private:
 
 class Source {
 public:
-	Source(const std::string& path);
-	~Source() = default;
+	// Sources that are created without loading them are filled out by load or a SourceLoader.
+	Source(const std::string& path, bool load_now = true);
+	~Source();
 
 	std::string path() { return m_path; }
 	const std::string& path() const { return m_path; }
@@ -203,9 +222,26 @@ public:
 	const char* start() const { return m_start; }
 	const char* end()   const { return m_end;   }
 
+	// Reads the whole file with a blocking read, leaves the source unloaded when it can't be opened.
+	void load();
+
+	// Readable bytes after the terminator, the text kernels load whole vectors that can run past it.
+	static const i32 PADDING = 32;
+
+	// Returns a buffer for file_size bytes of text, the text goes to buffer + 1. The bytes before and after
+	// the text are the line break, terminator and padding the tokenizer expects, adopt_buffer fills them in.
+	// The source owns an adopted buffer and frees it together with the one it replaces.
+	static char* allocate_buffer(i64 file_size);
+	void adopt_buffer(char* buffer, i64 file_size);
+
 private:
 
+	// Can't copy sources, they own their buffer
+	Source(const Source&) = delete;
+	Source& operator=(const Source&) = delete;
+
 	std::string m_path;
+	char* m_buffer = nullptr;
 
 	const char* m_start = 0;
 	const char* m_end = 0;
@@ -213,19 +249,49 @@ private:
 };
 
 
+/* \brief Turns the text of a module into tokens for the parser.
+ * A tokenizer that keeps its tokens produces all of them up front and can seek back to any of them. Otherwise
+ * tokens are produced as the parser asks for them and only the ones it has not eaten yet are held, in a small
+ * ring buffer, so memory does not grow with the size of the file.
+ */
 class Tokenizer
 {
 public:
-	Tokenizer(ModuleCompiler* module_compiler);
+	// The parser looks at most two tokens past the current one, the ring only grows past this for a
+	// burst of scope ends when many blocks close on the same line.
+	static const i32 STREAM_BUFFER_SIZE = 8;
+
+	Tokenizer(ModuleCompiler* module_compiler, bool keep_tokens = true);
 	~Tokenizer() = default;
 
-	Token peek(i32 ahead) const { return (ahead + m_current_token) >= m_tokens.size() ? m_tokens.back() : m_tokens[m_current_token + ahead]; }
-	Token peek() const { return m_tokens[m_current_token]; }
+	Token peek(i32 ahead = 0) {
+		if (ahead >= buffered_count() && !tokenize_ahead(ahead + 1))
+			return m_last_token;
+		return m_tokens[token_index(ahead)];
+	}
 	Token eat();
+
+	// Index of the next token, seeking back to one lets the parser return to a body it skipped.
+	// Only tokenizers that keep their tokens can seek.
+	i32 position() const { return m_current_token; }
+	void seek(i32 position) { assert(m_keep_tokens); m_current_token = position; }
+
+	// After an error the tokenizer stops and every further token is the end of the file.
+	bool encountered_error() const { return m_encountered_error; }
+	// Whether every token from before the error was eaten, the tokens from then on are made up.
+	bool reached_error() const { return m_encountered_error && eaten_count() >= m_error_token_count; }
 	
 private:
 
-	void tokenize();
+	i32 buffered_count() const { return m_keep_tokens ? (i32)m_tokens.size() - m_current_token : m_buffered_count; }
+	i32 produced_count() const { return m_keep_tokens ? (i32)m_tokens.size() : m_produced_count; }
+	i32 eaten_count() const { return produced_count() - buffered_count(); }
+	i32 token_index(i32 ahead) const { return m_keep_tokens ? m_current_token + ahead : (m_current_token + ahead) & ((i32)m_tokens.size() - 1); }
+
+	// Tokenizes until count tokens are waiting to be eaten, false when the file ends before that.
+	bool tokenize_ahead(i32 count);
+	void tokenize_next();
+	void push_token(const Token& token);
 
 	void tokenize_scopes();
 	void tokenize_identifier();
@@ -235,9 +301,11 @@ private:
 	void tokenize_eol();
 	void tokenize_eof();
 
+	// Looks the name up in this tokenizer's cache before going to the project's symbol table.
+	Symbol intern(const char* start, int length);
+
 	bool is_identifier();
 	bool is_digit();
-	bool is_whitespace();
 
 	void skip_new_line();
 	void skip_whitespace_and_comments();
@@ -245,10 +313,15 @@ private:
 	CompilerError* raise_error();
 
 	bool m_stop_tokenizing = false;
+	bool m_encountered_error = false;
+	bool m_at_line_start = true;
 
 	int m_indention_level = 0;
 	
 	ModuleCompiler* m_module_compiler;
+	SymbolTable* m_symbols;
+	const simd::TextKernels* m_text_kernels;
+	std::unordered_map<std::string_view, Symbol> m_symbol_cache;
 
 	const char* m_start   = 0;
 	const char* m_end     = 0;
@@ -256,8 +329,15 @@ private:
 
 	int m_current_line_number = 1;
 
-	int m_current_token = 0;
+	bool m_keep_tokens;
+	// All tokens when they are kept, otherwise a ring of the produced tokens that were not eaten yet.
 	std::vector<Token> m_tokens;
+	int m_current_token = 0;
+	int m_buffered_count = 0;
+	int m_produced_count = 0;
+	// Tokens produced before the error, only these came from the text.
+	int m_error_token_count = 0;
+	Token m_last_token;
 	std::stack<Token> m_opening_brackets;
 };
 
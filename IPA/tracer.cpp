@@ -0,0 +1,174 @@
+#include "tracer.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <stdint.h>
+
+
+Tracer::Tracer()
+	: m_recording(nullptr), m_inline_depth(0) {
+	for (i32 i = 0; i < HOT_LOOP_COUNT; i++) {
+		m_hot_loops[i].function = nullptr;
+		m_hot_loops[i].trace = nullptr;
+	}
+}
+
+Tracer::~Tracer() {
+	for (auto& function_traces : m_traces) {
+		for (Trace* trace : function_traces.second)
+			delete trace;
+	}
+	delete m_recording;
+}
+
+Trace* Tracer::on_back_edge(ast::Function* function, i32 header_pc) {
+	if (m_recording) {
+		if (m_recording->function == function && m_recording->header_pc == header_pc) {
+			// We made it around the loop, the trace simply starts over.
+			m_recording->code.push_back((u8)OpCode::OpTraceLoop);
+			finish_recording();
+		} else {
+			// An inner loop, it gets its own trace once it is hot.
+			abort_recording();
+		}
+	}
+
+	HotLoop& loop = get_hot_loop(function, header_pc);
+	if (loop.trace) {
+		++loop.trace->executions;
+		return loop.trace;
+	}
+	if (loop.blacklisted || m_recording || --loop.counter > 0)
+		return nullptr;
+
+	m_recording = new Trace();
+	m_recording->function = function;
+	m_recording->header_pc = header_pc;
+	m_recording->executions = 0;
+	m_recording->guard_failures = 0;
+	m_inline_depth = 0;
+	++loop.recording_attempts;
+	return nullptr;
+}
+
+void Tracer::record(const u8* instruction, i32 length) {
+	if (!m_recording)
+		return;
+	if ((i32)m_recording->code.size() + length > MAX_TRACE_LENGTH) {
+		abort_recording();
+		return;
+	}
+	m_recording->code.insert(m_recording->code.end(), instruction, instruction + length);
+}
+
+void Tracer::record_guard(bool condition, i32 exit_pc) {
+	if (!m_recording)
+		return;
+	emit_exit(condition ? OpCode::OpGuardTrue : OpCode::OpGuardFalse, exit_pc);
+}
+
+void Tracer::record_call_enter() {
+	if (m_recording && ++m_inline_depth > MAX_INLINE_DEPTH)
+		abort_recording();
+}
+
+void Tracer::record_call_leave() {
+	// Returning out of the function that owns the loop means the loop was left without closing it.
+	if (m_recording && --m_inline_depth < 0)
+		abort_recording();
+}
+
+void Tracer::record_loop_end(const u8* instruction, i32 length, i32 header_pc, i32 exit_pc) {
+	if (!m_recording)
+		return;
+	if (m_recording->header_pc != header_pc || m_inline_depth != 0) {
+		abort_recording();
+		return;
+	}
+
+	// The loop opcode ends in its i16 jump, point it back to the start of the trace.
+	assert(length >= 3);
+	std::vector<u8>& code = m_recording->code;
+	i32 offset = -((i32)code.size() + length);
+	assert((i16)offset == offset);
+	code.insert(code.end(), instruction, instruction + length - 2);
+	code.push_back((u8)(offset & 0xFF));
+	code.push_back((u8)((offset >> 8) & 0xFF));
+
+	emit_exit(OpCode::OpTraceExit, exit_pc);
+	finish_recording();
+}
+
+void Tracer::abort_recording() {
+	if (!m_recording)
+		return;
+	HotLoop& loop = get_hot_loop(m_recording->function, m_recording->header_pc);
+	loop.counter = HOT_LOOP_THRESHOLD;
+	loop.blacklisted = loop.recording_attempts >= MAX_RECORDING_ATTEMPTS;
+
+	delete m_recording;
+	m_recording = nullptr;
+}
+
+void Tracer::on_guard_failure(Trace* trace) {
+	++trace->guard_failures;
+	if (trace->executions < GUARD_FAILURE_RATIO || trace->guard_failures * GUARD_FAILURE_RATIO <= trace->executions)
+		return;
+
+	// The recorded path is not the common one, let the interpreter have the loop back.
+	HotLoop& loop = get_hot_loop(trace->function, trace->header_pc);
+	assert(loop.trace == trace);
+	loop.trace = nullptr;
+	loop.blacklisted = true;
+
+	std::vector<Trace*>& traces = m_traces[trace->function];
+	traces.erase(std::find(traces.begin(), traces.end(), trace));
+	delete trace;
+}
+
+Tracer::HotLoop& Tracer::get_hot_loop(ast::Function* function, i32 header_pc) {
+	u64 hash = ((u64)(uintptr_t)function >> 3) ^ ((u64)header_pc * 2654435761u);
+	HotLoop& loop = m_hot_loops[hash % HOT_LOOP_COUNT];
+	if (loop.function != function || loop.header_pc != header_pc) {
+		loop.function = function;
+		loop.header_pc = header_pc;
+		loop.counter = HOT_LOOP_THRESHOLD;
+		loop.recording_attempts = 0;
+		loop.trace = find_trace(function, header_pc);
+		loop.blacklisted = false;
+	}
+	return loop;
+}
+
+Trace* Tracer::find_trace(ast::Function* function, i32 header_pc) {
+	auto it = m_traces.find(function);
+	if (it == m_traces.end())
+		return nullptr;
+	for (Trace* trace : it->second) {
+		if (trace->header_pc == header_pc)
+			return trace;
+	}
+	return nullptr;
+}
+
+void Tracer::finish_recording() {
+	HotLoop& loop = get_hot_loop(m_recording->function, m_recording->header_pc);
+	assert(!loop.trace);
+	loop.trace = m_recording;
+	loop.recording_attempts = 0;
+	m_traces[m_recording->function].push_back(m_recording);
+	m_recording = nullptr;
+}
+
+void Tracer::emit_exit(OpCode opcode, i32 exit_pc) {
+	std::vector<u8>& code = m_recording->code;
+	if ((i32)code.size() + 3 > MAX_TRACE_LENGTH || m_recording->exits.size() > 0xFFFF) {
+		abort_recording();
+		return;
+	}
+	u16 exit_index = (u16)m_recording->exits.size();
+	m_recording->exits.push_back({ (i32)code.size(), exit_pc });
+	code.push_back((u8)opcode);
+	code.push_back((u8)(exit_index & 0xFF));
+	code.push_back((u8)(exit_index >> 8));
+}
@@ -0,0 +1,102 @@
+#ifndef TRACER_H
+#define TRACER_H
+#include "common.h"
+#include "opcodes.h"
+
+#include <unordered_map>
+
+namespace ast {
+	struct Function;
+}
+
+
+/* \brief Where a trace hands control back to the interpreter.
+ */
+struct TraceExit {
+	i32 trace_offset; // Offset of the guard or exit instruction inside the trace.
+	i32 resume_pc;    // Bytecode offset in the loop's function the interpreter continues at.
+};
+
+/* \brief Straight line recording of one iteration through a hot loop.
+ * Branches are replaced by guards on the direction taken while recording and calls are inlined,
+ * so the whole iteration is a single basic block that ends by jumping back to its own start.
+ */
+struct Trace {
+	ast::Function* function;
+	i32 header_pc;
+
+	std::vector<u8> code;
+	std::vector<TraceExit> exits;
+
+	i64 executions;
+	i64 guard_failures;
+};
+
+/* \brief Finds hot loops and records traces for them.
+ * The interpreter reports every loop back edge, once a loop header was reached often enough the
+ * next iteration is recorded instruction by instruction and the finished trace replaces the loop.
+ */
+class Tracer
+{
+public:
+	static const i32 HOT_LOOP_THRESHOLD = 56;
+	static const i32 MAX_TRACE_LENGTH = 4096;
+	static const i32 MAX_INLINE_DEPTH = 4;
+	// Traces whose guards fail more often than one in this many runs are thrown away and blacklisted.
+	static const i32 GUARD_FAILURE_RATIO = 8;
+	// Loops that keep aborting their recording, for example by calling too deep, are left to the interpreter.
+	static const i32 MAX_RECORDING_ATTEMPTS = 3;
+
+	Tracer();
+	~Tracer();
+
+	// Called on every loop back edge, returns the trace to run instead of the loop body or null.
+	// Starts or finishes a recording as a side effect.
+	Trace* on_back_edge(ast::Function* function, i32 header_pc);
+
+	bool is_recording() const { return m_recording != nullptr; }
+
+	// Copies one instruction that does not branch.
+	void record(const u8* instruction, i32 length);
+	// Records a conditional branch as a guard, exit_pc is where the interpreter resumes when the
+	// condition does not match what it was during recording.
+	void record_guard(bool condition, i32 exit_pc);
+	// Calls are inlined into the trace, too deep call chains abort the recording.
+	void record_call_enter();
+	void record_call_leave();
+	// Records a counted loop opcode such as OpForRangeI32, it closes the trace when it belongs to the
+	// recorded loop. exit_pc is the instruction following the loop.
+	void record_loop_end(const u8* instruction, i32 length, i32 header_pc, i32 exit_pc);
+	void abort_recording();
+
+	// Reports a failed guard, traces that keep failing are deleted so trace must not be used afterwards.
+	void on_guard_failure(Trace* trace);
+
+private:
+	struct HotLoop {
+		ast::Function* function;
+		i32 header_pc;
+		i32 counter;
+		i32 recording_attempts;
+		Trace* trace;
+		bool blacklisted;
+	};
+
+	HotLoop& get_hot_loop(ast::Function* function, i32 header_pc);
+	Trace* find_trace(ast::Function* function, i32 header_pc);
+	void finish_recording();
+	void emit_exit(OpCode opcode, i32 exit_pc);
+
+	// Direct mapped, two loops sharing a slot just steal it from each other.
+	static const i32 HOT_LOOP_COUNT = 256;
+	HotLoop m_hot_loops[HOT_LOOP_COUNT];
+	// Owns every finished trace, a slot only points at one. Losing the slot does not free the trace
+	// as it may still be running, the loop picks it up again once it gets the slot back.
+	std::unordered_map<ast::Function*, std::vector<Trace*>> m_traces;
+
+	Trace* m_recording;
+	i32 m_inline_depth;
+};
+
+
+#endif // TRACER_H
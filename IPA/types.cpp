@@ -40,9 +40,84 @@ void ast::Type::InitializePrimitveTypes() {
 
 	s_primitive_types[(i32)Primitive::F64Primitive].size  = sizeof(f64);
 	s_primitive_types[(i32)Primitive::F64Primitive].flags = DECIMAL | (u32)Primitive::F64Primitive;
+
+	s_primitive_types[(i32)Primitive::F32x4Primitive].size  = 4 * sizeof(f32);
+	s_primitive_types[(i32)Primitive::F32x4Primitive].flags = VECTOR | DECIMAL | (u32)Primitive::F32x4Primitive;
+
+	s_primitive_types[(i32)Primitive::F64x2Primitive].size  = 2 * sizeof(f64);
+	s_primitive_types[(i32)Primitive::F64x2Primitive].flags = VECTOR | DECIMAL | (u32)Primitive::F64x2Primitive;
+
+	s_primitive_types[(i32)Primitive::S32x4Primitive].size  = 4 * sizeof(i32);
+	s_primitive_types[(i32)Primitive::S32x4Primitive].flags = VECTOR | SIGNED | (u32)Primitive::S32x4Primitive;
+
+	s_primitive_types[(i32)Primitive::F32x8Primitive].size  = 8 * sizeof(f32);
+	s_primitive_types[(i32)Primitive::F32x8Primitive].flags = VECTOR | DECIMAL | (u32)Primitive::F32x8Primitive;
+
+	s_primitive_types[(i32)Primitive::F64x4Primitive].size  = 4 * sizeof(f64);
+	s_primitive_types[(i32)Primitive::F64x4Primitive].flags = VECTOR | DECIMAL | (u32)Primitive::F64x4Primitive;
+
+	s_primitive_types[(i32)Primitive::S32x8Primitive].size  = 8 * sizeof(i32);
+	s_primitive_types[(i32)Primitive::S32x8Primitive].flags = VECTOR | SIGNED | (u32)Primitive::S32x8Primitive;
 }
 
 ast::Type* ast::Type::GetPrimitiveOrAssert(Primitive primitive) {
 	assert(primitive != Primitive::NoPrimitive && (i32)primitive < (i32)Primitive::PrimtiveCount);
 	return &s_primitive_types[(i32)primitive];
-}
\ No newline at end of file
+}
+
+ast::Type* ast::Type::get_lane_type_or_null() const {
+	switch (primitive()) {
+	case(Primitive::F32x4Primitive):
+	case(Primitive::F32x8Primitive): return GetPrimitiveOrAssert(Primitive::F32Primitive);
+	case(Primitive::F64x2Primitive):
+	case(Primitive::F64x4Primitive): return GetPrimitiveOrAssert(Primitive::F64Primitive);
+	case(Primitive::S32x4Primitive):
+	case(Primitive::S32x8Primitive): return GetPrimitiveOrAssert(Primitive::S32Primitive);
+	default:
+		return nullptr;
+	}
+}
+
+i32 ast::Type::lane_count() const {
+	Type* lane_type = get_lane_type_or_null();
+	return lane_type ? (i32)(size / lane_type->size) : 0;
+}
+
+ast::StructType::StructType(Struct* structure)
+	: Type(0, STRUCT), structure(structure) {}
+
+ast::StructType* ast::StructType::Create(CompilerAllocator* allocator, Struct* structure) {
+	StructType* memory = allocator->allocate_one<StructType>();
+	return new (memory)(StructType)(structure);
+}
+
+bool ast::StructType::is_soa() const {
+	return (structure->decl_flags & Decl::SOA) == Decl::SOA;
+}
+
+
+ast::ArrayType::ArrayType(Type* element_type)
+	: Type(sizeof(void*), ARRAY), element_type(element_type) {}
+
+ast::ArrayType* ast::ArrayType::Create(CompilerAllocator* allocator, Type* element_type) {
+	ArrayType* memory = allocator->allocate_one<ArrayType>();
+	return new (memory)(ArrayType)(element_type);
+}
+
+
+ast::ChannelType::ChannelType(Type* element_type, u32 capacity)
+	: Type(sizeof(void*), CHANNEL), element_type(element_type), capacity(capacity) {}
+
+ast::ChannelType* ast::ChannelType::Create(CompilerAllocator* allocator, Type* element_type, u32 capacity) {
+	ChannelType* memory = allocator->allocate_one<ChannelType>();
+	return new (memory)(ChannelType)(element_type, capacity);
+}
+
+
+ast::UnresolvedType::UnresolvedType(const Token& name)
+	: Type(0, UNRESOLVED), name(name), resolved_type(nullptr) {}
+
+ast::UnresolvedType* ast::UnresolvedType::Create(CompilerAllocator* allocator, const Token& name) {
+	UnresolvedType* memory = allocator->allocate_one<UnresolvedType>();
+	return new (memory)(UnresolvedType)(name);
+}
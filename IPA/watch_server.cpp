@@ -0,0 +1,233 @@
+#include "watch_server.h"
+#include "project.h"
+#include "compiler.h"
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+
+#ifdef __linux__
+#include <errno.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+
+WatchServer::WatchServer(Project* project, Compiler* compiler)
+	: m_project(project), m_compiler(compiler) {
+}
+
+std::string WatchServer::report() {
+	if (!m_compiler->encountered_error())
+		return "ok\n";
+	std::ostringstream stream;
+	m_compiler->print_errors(stream);
+	return stream.str();
+}
+
+void WatchServer::compile_changes() {
+	if (m_changed_modules.empty())
+		return;
+
+	std::vector<Module*> changed_modules;
+	changed_modules.swap(m_changed_modules);
+	for (auto module : changed_modules)
+		std::cout << "Changed '" << module->path() << "'" << std::endl;
+
+	m_compiler->recompile(changed_modules);
+	std::cout << report() << std::flush;
+}
+
+
+#ifdef __linux__
+
+WatchServer::~WatchServer() {
+	if (m_listen_fd >= 0) {
+		::close(m_listen_fd);
+		unlink(m_project->settings().socket_path.c_str());
+	}
+	if (m_inotify_fd >= 0)
+		::close(m_inotify_fd);
+}
+
+i32 WatchServer::run() {
+	if (!watch_sources() || !listen())
+		return -1;
+	std::cout << "Watching " << m_modules.size() << " files, serving on '" << m_project->settings().socket_path << "'" << std::endl;
+
+	while (!m_stop) {
+		pollfd fds[2] = {
+			{ m_inotify_fd, POLLIN, 0 },
+			{ m_listen_fd,  POLLIN, 0 },
+		};
+		if (poll(fds, 2, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+
+		if (fds[0].revents & POLLIN) {
+			// Saving a file is often several events spread over a few milliseconds, wait them out.
+			do {
+				read_changes();
+				fds[0].revents = 0;
+			} while (poll(fds, 1, SETTLE_MS) > 0);
+			compile_changes();
+		}
+		if (fds[1].revents & POLLIN) {
+			i32 client = accept4(m_listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+			if (client >= 0) {
+				serve(client);
+				::close(client);
+			}
+		}
+	}
+	return 0;
+}
+
+bool WatchServer::watch_sources() {
+	m_inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (m_inotify_fd < 0) {
+		std::cerr << "Can't watch the sources, inotify is not available" << std::endl;
+		return false;
+	}
+
+	// Folders are watched rather than files, editors often save by replacing the file.
+	std::map<std::string, i32> watched_folders;
+	for (auto it = m_project->modules_begin(); it != m_project->modules_end(); ++it) {
+		const std::string& path = it->second->path();
+		auto slash = path.find_last_of('/');
+		std::string folder = slash == std::string::npos ? "." : path.substr(0, slash);
+		std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+
+		if (watched_folders.find(folder) == watched_folders.end()) {
+			i32 watch = inotify_add_watch(m_inotify_fd, folder.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+			if (watch < 0) {
+				std::cerr << "Can't watch folder '" << folder << "'" << std::endl;
+				return false;
+			}
+			watched_folders[folder] = watch;
+			m_folders[watch] = folder;
+		}
+		m_modules[folder + "/" + name] = it->second;
+	}
+	return true;
+}
+
+bool WatchServer::listen() {
+	const std::string& socket_path = m_project->settings().socket_path;
+	sockaddr_un address = {};
+	address.sun_family = AF_UNIX;
+	if (socket_path.size() >= sizeof(address.sun_path)) {
+		std::cerr << "Socket path '" << socket_path << "' is too long" << std::endl;
+		return false;
+	}
+	socket_path.copy(address.sun_path, socket_path.size());
+
+	// A socket left behind by a daemon that did not shut down would make bind fail, it is removed unless
+	// a server still accepts connections on it.
+	i32 probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	bool is_served = probe >= 0 && connect(probe, (sockaddr*)&address, sizeof(address)) == 0;
+	if (probe >= 0)
+		::close(probe);
+	if (is_served) {
+		std::cerr << "Another watch server is already serving on '" << socket_path << "'" << std::endl;
+		return false;
+	}
+	unlink(socket_path.c_str());
+
+	m_listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (m_listen_fd < 0 || bind(m_listen_fd, (sockaddr*)&address, sizeof(address)) < 0 || ::listen(m_listen_fd, 8) < 0) {
+		std::cerr << "Can't listen on '" << socket_path << "'" << std::endl;
+		// The socket path is not ours, keep the destructor from removing it.
+		if (m_listen_fd >= 0)
+			::close(m_listen_fd);
+		m_listen_fd = -1;
+		return false;
+	}
+	return true;
+}
+
+void WatchServer::read_changes() {
+	alignas(inotify_event) char buffer[4096];
+	while (true) {
+		ssize_t size = read(m_inotify_fd, buffer, sizeof(buffer));
+		if (size <= 0)
+			return;
+
+		for (char* at = buffer; at < buffer + size; ) {
+			inotify_event* event = (inotify_event*)at;
+			at += sizeof(inotify_event) + event->len;
+			if (event->len == 0)
+				continue;
+
+			auto folder = m_folders.find(event->wd);
+			if (folder == m_folders.end())
+				continue;
+			auto module = m_modules.find(folder->second + "/" + event->name);
+			if (module == m_modules.end())
+				continue;
+			if (std::find(m_changed_modules.begin(), m_changed_modules.end(), module->second) == m_changed_modules.end())
+				m_changed_modules.push_back(module->second);
+		}
+	}
+}
+
+void WatchServer::serve(i32 client) {
+	timeval timeout = { CLIENT_TIMEOUT_MS / 1000, (CLIENT_TIMEOUT_MS % 1000) * 1000 };
+	setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+	std::string request;
+	char buffer[256];
+	while (request.find('\n') == std::string::npos) {
+		ssize_t size = recv(client, buffer, sizeof(buffer), 0);
+		// Timed out, the client is dropped without an answer.
+		if (size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return;
+		if (size <= 0)
+			break;
+		request.append(buffer, (size_t)size);
+	}
+	request = request.substr(0, request.find_first_of("\r\n"));
+
+	std::string response;
+	if (request == "compile") {
+		// The client may have saved a file just before asking, take whatever the kernel has queued.
+		read_changes();
+		compile_changes();
+		response = report();
+	} else if (request == "stop") {
+		m_stop = true;
+		response = "stopping\n";
+	} else {
+		response = "unknown request '" + request + "', expected compile or stop\n";
+	}
+
+	for (size_t sent = 0; sent < response.size(); ) {
+		ssize_t size = send(client, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+		if (size <= 0)
+			break;
+		sent += (size_t)size;
+	}
+}
+
+#else
+
+WatchServer::~WatchServer() {
+}
+
+i32 WatchServer::run() {
+	std::cerr << "Watch mode needs inotify and is only available on Linux" << std::endl;
+	return -1;
+}
+
+bool WatchServer::watch_sources() { return false; }
+bool WatchServer::listen() { return false; }
+void WatchServer::read_changes() {}
+void WatchServer::serve(i32 client) {}
+
+#endif
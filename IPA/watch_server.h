@@ -0,0 +1,61 @@
+#ifndef WATCH_SERVER_H
+#define WATCH_SERVER_H
+#include "common.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+class Project;
+class Compiler;
+class Module;
+
+
+/* \brief Keeps a compiled project in memory and compiles it again whenever one of its files is saved.
+ * The folders of all source files are watched with inotify, a burst of changes is collected until the
+ * folders have been quiet for a moment and only the changed modules and their dependents are compiled.
+ * Clients talk to it over a local Unix socket, one request per connection:
+ *   compile   applies any pending change and answers with the errors of the project, or "ok"
+ *   stop      answers "stopping" and makes run return
+ */
+class WatchServer
+{
+public:
+	// How long the folders have to be quiet before a burst of changes is compiled.
+	static const i32 SETTLE_MS = 50;
+	// How long a client may take to send its request or to take the response, so a client that
+	// connects and then stalls can't hold up the server.
+	static const i32 CLIENT_TIMEOUT_MS = 2000;
+
+	WatchServer(Project* project, Compiler* compiler);
+	~WatchServer();
+
+	// Serves until a client asks it to stop, returns -1 when watching or listening can't be set up,
+	// which includes another server already serving on the socket.
+	i32 run();
+
+private:
+	bool watch_sources();
+	bool listen();
+
+	// Adds the modules of all queued file events to m_changed_modules without waiting for more.
+	void read_changes();
+	void compile_changes();
+	void serve(i32 client);
+	std::string report();
+
+	Project* m_project;
+	Compiler* m_compiler;
+
+	i32 m_inotify_fd = -1;
+	i32 m_listen_fd = -1;
+	// Watched folder of each watch descriptor, and the module behind each watched file.
+	std::map<i32, std::string> m_folders;
+	std::map<std::string, Module*> m_modules;
+
+	std::vector<Module*> m_changed_modules;
+	bool m_stop = false;
+};
+
+
+#endif // WATCH_SERVER_H